@@ -17,19 +17,15 @@ class Namespace;
 namespace dex
 {
 
+class Output;
+
 class File
 {
 public:
-
-  struct TypeInfo {
-    script::Type type;
-  };
-
-  static TypeInfo static_type_info;
-  inline static TypeInfo & type_info() { return static_type_info; }
-
   static void register_type(script::Namespace ns);
 
+  static bool writeIfChanged(const QString & path, const QByteArray & content, Output *output);
+
   static QFile & get(const script::Value & val);
   static QFile::OpenMode getOpenMode(const script::Value & val);
 };
@@ -0,0 +1,75 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_CONTEXT_H
+#define DEX_CONTEXT_H
+
+#include "dex/processor/documentprocessor.h"
+#include "dex/processor/state.h"
+
+#include <script/engine.h>
+
+#include <QByteArray>
+#include <QDir>
+
+#include <memory>
+#include <vector>
+
+namespace dex
+{
+
+class Output;
+
+/*!
+ * \class Context
+ * \brief Holds a script engine and everything that is bound to it.
+ *
+ * A context owns the engine, the State, the DocumentProcessor and the
+ * outputs of a documentation pipeline. Several contexts may exist at the
+ * same time, each of them being used by one thread at a time.
+ *
+ * Native callbacks retrieve the context of the engine that invokes them
+ * with get().
+ */
+class Context
+{
+public:
+  Context();
+  Context(const Context &) = delete;
+  ~Context();
+
+  inline script::Engine* engine() { return &mEngine; }
+
+  inline dex::State & state() { return mState; }
+  void setState(const dex::State & state);
+
+  inline DocumentProcessor* documentProcessor() const { return mDocumentProcessor.get(); }
+
+  inline const std::vector<std::unique_ptr<Output>> & outputs() const { return mOutputs; }
+  void addOutput(std::unique_ptr<Output> && output);
+
+  inline Output* output() const { return mOutput; }
+  void setOutput(Output *output);
+
+  inline const QDir & profileDirectory() const { return mProfileDirectory; }
+  void setProfileDirectory(const QDir & dir);
+  const QByteArray & profileHash();
+
+  static Context* get(script::Engine *e);
+
+  Context & operator=(const Context &) = delete;
+
+private:
+  script::Engine mEngine;
+  dex::State mState;
+  std::unique_ptr<DocumentProcessor> mDocumentProcessor;
+  std::vector<std::unique_ptr<Output>> mOutputs;
+  Output *mOutput;
+  QDir mProfileDirectory;
+  QByteArray mProfileHash;
+};
+
+} // namespace dex
+
+#endif // DEX_CONTEXT_H
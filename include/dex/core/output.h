@@ -10,6 +10,8 @@
 
 #include <json-toolkit/json.h>
 
+#include <QHash>
+#include <QSet>
 #include <QString>
 
 #include <map>
@@ -29,8 +31,10 @@ public:
 
   void write(const QString& outdir);
 
-  static Output* staticCurrentOutput;
-  static Output* current();
+  bool isUpToDate(const QString& page, const QString& digest);
+  void setRendered(const QString& page, const QString& digest);
+
+  void recordFile(const QString& path);
 
   static void expose(script::Namespace& ns);
 
@@ -39,10 +43,20 @@ protected:
   QString stringify(const json::Array& val, const script::Function& to_string);
   QString stringify(const json::Object& val, const script::Function& to_string);
 
+  void loadManifest(const QString& outdir, const QByteArray& profileHash);
+  void saveManifest();
+  void pruneStaleFiles();
+
 private:
   script::Value m_self;
   script::Function m_write;
   std::map<int, script::Function> m_tostring_functions;
+  QString m_outdir;
+  QString m_profile_digest;
+  QHash<QString, QString> m_previous_digests;
+  QHash<QString, QString> m_digests;
+  QSet<QString> m_previous_files;
+  QSet<QString> m_files;
 };
 
 } // namespace dex
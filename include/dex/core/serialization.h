@@ -10,8 +10,11 @@
 #include <script/types.h>
 #include <script/value.h>
 
+#include <QByteArray>
+
 namespace script
 {
+class Engine;
 class Namespace;
 } // namespace script
 
@@ -34,7 +37,11 @@ namespace serialization
 {
 
 json::Json serialize(const script::Value& val);
-script::Value deserialize(const json::Json& json, script::Type type);
+script::Value deserialize(script::Engine* e, const json::Json& json, script::Type type);
+
+QByteArray toJsonText(const json::Json& json);
+json::Json fromJsonText(const QByteArray& data);
+QString digest(const json::Json& json);
 
 void expose(script::Namespace& ns);
 
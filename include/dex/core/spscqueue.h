@@ -0,0 +1,83 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_SPSC_QUEUE_H
+#define DEX_SPSC_QUEUE_H
+
+#include <QAtomicInt>
+
+#include <utility>
+#include <vector>
+
+namespace dex
+{
+
+/*!
+ * \class SpscQueue
+ * \brief A bounded lock-free queue with a single producer and a single consumer.
+ *
+ * tryPush() must only be called from the producer thread and tryPop()
+ * only from the consumer thread. Neither of them blocks: they return
+ * false when the queue is respectively full or empty.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(int capacity)
+    : mSlots(capacity + 1)
+    , mHead(0)
+    , mTail(0)
+  {
+
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+
+  inline int capacity() const { return static_cast<int>(mSlots.size()) - 1; }
+
+  // Moves value into the queue; value is left untouched if the queue is full.
+  bool tryPush(T & value)
+  {
+    const int tail = mTail.load();
+    const int next = increment(tail);
+
+    if (next == mHead.loadAcquire())
+      return false;
+
+    mSlots[tail] = std::move(value);
+    mTail.storeRelease(next);
+    return true;
+  }
+
+  bool tryPop(T & value)
+  {
+    const int head = mHead.load();
+
+    if (head == mTail.loadAcquire())
+      return false;
+
+    value = std::move(mSlots[head]);
+    mSlots[head] = T{};
+    mHead.storeRelease(increment(head));
+    return true;
+  }
+
+  SpscQueue & operator=(const SpscQueue &) = delete;
+
+protected:
+  inline int increment(int index) const
+  {
+    return index + 1 == static_cast<int>(mSlots.size()) ? 0 : index + 1;
+  }
+
+private:
+  std::vector<T> mSlots;
+  QAtomicInt mHead; // next slot to be read, written by the consumer
+  QAtomicInt mTail; // next slot to be written, written by the producer
+};
+
+} // namespace dex
+
+#endif // DEX_SPSC_QUEUE_H
@@ -13,6 +13,8 @@
 #include <QList>
 
 #include <map>
+#include <mutex>
+#include <utility>
 
 namespace dex
 {
@@ -25,7 +27,10 @@ struct ValueTypeInfo : public script::UserData
 
   static std::shared_ptr<ValueTypeInfo> get(const script::Function & f);
   static std::shared_ptr<ValueTypeInfo> get(const script::Type & t, script::Engine *e);
-  static std::map<int, std::shared_ptr<ValueTypeInfo>> & cache();
+  static void purge(script::Engine *e);
+  // the functions of a type are specific to the engine it belongs to
+  static std::map<std::pair<script::Engine*, int>, std::shared_ptr<ValueTypeInfo>> & cache();
+  static std::mutex & cache_mutex();
 };
 
 // gives value semantic to a script::Value
@@ -5,26 +5,19 @@
 #ifndef DEX_H
 #define DEX_H
 
-#include <QApplication>
+#include <QCoreApplication>
 
-#include "dex/processor/state.h"
+#include "dex/context.h"
+#include "dex/processor/filecache.h"
 
 #include <script/classtemplate.h>
-#include <script/engine.h>
 
 #include <QDir>
 #include <QSharedPointer>
 
-namespace dex
-{
-class DocumentProcessor;
-class Environment;
-class Output;
-} // namespace dex
-
 class QSettings;
 
-class Application : public QApplication
+class Application : public QCoreApplication
 {
   Q_OBJECT
 public:
@@ -48,21 +41,24 @@ public:
 
   QDir activeProfileDir() const;
 
-  dex::DocumentProcessor* documentProcessor();
+  int jobs() const;
 
-  static script::Engine* scriptEngine();
+  dex::Context & context();
 
 private:
   void parserCommandLineArgs();
-  void fetchModules();
-  void fetchModule(const QString& dirpath);
+  void fetchModules(dex::Context & context);
+  void fetchModule(dex::Context & context, const QString& dirpath);
 
-  void load_state();
-  void load_outputs();
+  void initContext(dex::Context & context);
+  void setupContext(dex::Context & context);
+  void load_state(dex::Context & context);
+  void load_outputs(dex::Context & context);
+
+  dex::DocumentProcessor::Statistics processInParallel(const QStringList & files, int jobs);
 
 private:
-  script::Engine mEngine;
-  dex::State mState;
+  dex::Context mContext;
 
   struct CommandLineOptions
   {
@@ -74,23 +70,21 @@ private:
     QString profilesDirectory;
     QString activeProfile;
     bool saveSettings;
+    int jobs;
+    int readAheadFiles;
+    int readAheadMemory; // in MiB
+    QStringList includePatterns;
+    QStringList excludePatterns;
+    QStringList extensions;
+    bool ignoreFiles;
+    QString cacheDirectory;
   };
 
   CommandLineOptions mCliOptions;
 
-  std::unique_ptr<dex::DocumentProcessor> mDocumentProcessor;
-  //QList<QSharedPointer<dex::Output>> mOutputs;
-  std::vector<std::unique_ptr<dex::Output>> mOutputs;
+  std::unique_ptr<dex::FileCache> mFileCache;
+
   QSettings *mSettings;
 };
 
-#if defined(qApp)
-#undef qApp
-#endif
-#define qApp (static_cast<Application *>(QCoreApplication::instance()))
-
-#define Dex Application
-
-inline Application* DexInstance() { return static_cast<Application*>(QCoreApplication::instance()); }
-
 #endif // DEX_H
@@ -0,0 +1,69 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_BLOCK_SCANNER_H
+#define DEX_BLOCK_SCANNER_H
+
+#include <QByteArrayMatcher>
+#include <QString>
+#include <QStringMatcher>
+#include <QVector>
+
+namespace dex
+{
+
+/*!
+ * \class BlockScanner
+ * \brief Locates all the documentation blocks of a document.
+ *
+ * A scanner may hold several pairs of delimiters; the whole document is
+ * searched in a single forward pass, so that the parser knows the range
+ * of each block before reading it.
+ *
+ * A pair whose end delimiter is empty describes line comments: the block
+ * then extends over all the consecutive lines starting with the start
+ * delimiter.
+ */
+class BlockScanner
+{
+public:
+  BlockScanner();
+  BlockScanner(const QString & start, const QString & end);
+
+  void setDelimiters(const QString & start, const QString & end);
+  void addDelimiters(const QString & start, const QString & end);
+
+  struct Delimiters
+  {
+    QStringMatcher start;
+    QStringMatcher end;
+    QByteArrayMatcher utf8_start;
+
+    inline bool isLineComment() const { return end.pattern().isEmpty(); }
+  };
+
+  inline int delimitersCount() const { return mDelimiters.size(); }
+  inline const Delimiters & delimiters(int i) const { return mDelimiters.at(i); }
+
+  struct Block
+  {
+    int begin; // position right after the start delimiter
+    int end; // position of the end delimiter
+    int delimiters; // index of the delimiters of the block
+  };
+
+  bool mayContainBlock(const char *utf8, int size) const;
+
+  QVector<Block> scan(const QString & document) const;
+
+protected:
+  int findEnd(const QString & document, const Delimiters & delims, int from) const;
+
+private:
+  QVector<Delimiters> mDelimiters;
+};
+
+} // namespace dex
+
+#endif // DEX_BLOCK_SCANNER_H
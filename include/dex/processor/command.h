@@ -33,13 +33,6 @@ public:
   virtual CommandSpan::Value span() const = 0;
   virtual bool acceptsOptions() const = 0;
 
-  struct TypeInfo {
-    script::Type type;
-  };
-
-  static TypeInfo static_type_info;
-  inline static TypeInfo & type_info() { return static_type_info; }
-
   static void registerCommandType(script::Engine *e);
   static QSharedPointer<Command> build(const script::Function & func);
   static QSharedPointer<Command> build(const script::Class & cla);
@@ -25,6 +25,7 @@ public:
     Word,
     Line,
     Paragraph,
+    Raw,
   };
 
   Value value = NotApplicable;
@@ -32,16 +33,6 @@ public:
   static script::Type getBaseType();
   static script::Type getType(Value val);
 
-  struct TypeInfo {
-    script::Type span_type;
-    script::Type word_type;
-    script::Type line_type;
-    script::Type paragraph_type;
-  };
-
-  static TypeInfo static_type_info;
-  inline static TypeInfo & type_info() { return static_type_info; }
-
   static void register_span_types(script::Namespace ns);
 
   static script::Value expose(Value val, script::Engine *e);
@@ -68,6 +59,12 @@ public:
   Paragraph() { value = CommandSpan::Paragraph; }
 };
 
+class Raw : public CommandSpan
+{
+public:
+  Raw() { value = CommandSpan::Raw; }
+};
+
 } // namespace span
 
 } // namespace dex
@@ -77,6 +74,7 @@ namespace script
 template<> struct make_type_helper<dex::span::Word> { static Type get() { return Type::DexSpanWord; } };
 template<> struct make_type_helper<dex::span::Line> { static Type get() { return Type::DexSpanLine; } };
 template<> struct make_type_helper<dex::span::Paragraph> { static Type get() { return Type::DexSpanParagraph; } };
+template<> struct make_type_helper<dex::span::Raw> { static Type get() { return Type::DexSpanRaw; } };
 } // namespace script
 
 #endif // DEX_COMMAND_SPAN_H
@@ -0,0 +1,64 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_DIRECTORY_WALKER_H
+#define DEX_DIRECTORY_WALKER_H
+
+#include <QDir>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QVector>
+
+namespace dex
+{
+
+/*!
+ * \class DirectoryWalker
+ * \brief Lists the files of a directory tree that may be processed.
+ *
+ * Patterns follow the .gitignore syntax: a pattern without a slash is
+ * matched against the name of each file or directory, while a pattern
+ * containing one is matched against the path relative to the root.
+ *
+ * Directories are enumerated by several threads; the result is sorted
+ * by path so that it does not depend on the scheduling. A directory that
+ * is reachable through several symbolic links is only listed once, under
+ * the first of its paths.
+ */
+class DirectoryWalker
+{
+public:
+  DirectoryWalker();
+
+  void addIncludePattern(const QString & pattern);
+  void addExcludePattern(const QString & pattern);
+  void addExtension(const QString & ext);
+
+  inline const QStringList & ignoreFiles() const { return mIgnoreFiles; }
+  void setIgnoreFiles(const QStringList & names);
+
+  inline int workers() const { return mWorkers; }
+  void setWorkers(int n);
+
+  QStringList list(const QDir & root) const;
+
+  struct Pattern
+  {
+    QRegularExpression regexp;
+    bool negated;
+    bool directoryOnly;
+  };
+
+  static bool parsePattern(const QString & line, Pattern & result);
+
+private:
+  QVector<Pattern> mIncludes;
+  QVector<Pattern> mExcludes;
+  QStringList mIgnoreFiles;
+  int mWorkers;
+};
+
+} // namespace dex
+
+#endif // DEX_DIRECTORY_WALKER_H
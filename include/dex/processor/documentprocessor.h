@@ -6,18 +6,25 @@
 #define DEX_DOCUMENT_PROCESSOR_H
 
 #include "dex/core/json.h"
+#include "dex/processor/blockscanner.h"
+#include "dex/processor/directorywalker.h"
 #include "dex/processor/environment.h"
+#include "dex/processor/node.h"
 #include "dex/processor/state.h"
 
 #include <QDir>
-#include <QSet>
+#include <QRegExp>
 #include <QStack>
 
+#include <exception>
+
 class QStringRef;
 
 namespace dex
 {
 
+class FileCache;
+
 class InputStream
 {
 public:
@@ -37,9 +44,13 @@ public:
 
   void discard(int n);
 
+  void seek(int pos);
+  void setBoundary(int pos);
+
   struct Document
   {
     int pos;
+    int end;
     QString content;
 
     inline int length() const { return content.length(); }
@@ -78,23 +89,49 @@ public:
     };
 
     Kind kind;
-    QString text;
+    QString source; // shares the content of the document the token was read from
+    int offset;
+    int length;
+
+    inline QStringRef text() const { return QStringRef(&source, offset, length); }
+    inline QString toString() const { return source.mid(offset, length); }
+    inline bool isEmpty() const { return length == 0; }
   };
 
   QChar EscapeCharacter;
 
   Token read();
 
+  enum CharacterClass {
+    WordCharacter = 0,
+    SpaceCharacter,
+    EndOfLineCharacter,
+    BeginGroupCharacter,
+    EndGroupCharacter,
+    PunctuatorCharacter,
+  };
+
+  static CharacterClass characterClass(QChar c);
+
+  struct Lexeme
+  {
+    Token::Kind kind;
+    int offset;
+    int length;
+  };
+
+  static Token::Kind lex(const QChar *data, int begin, int end, QChar escape, int *length);
+  static void tokenize(const QString & text, int begin, int end, QChar escape, QVector<Lexeme> & result);
+
+  void setLookahead(const QVector<Lexeme> *lexemes);
+
 protected:
-  void readChar();
-  bool isPunctuatorOrSpace(const QChar & c) const;
-  bool readSpaces();
-  Token produce(Token::Kind k);
+  Token produce(Token::Kind k, int length);
 
 private:
   InputStream *mStream;
-  QSet<QChar> mPunctuators;
-  QString mBuffer;
+  const QVector<Lexeme> *mLookahead;
+  int mLookaheadIndex;
 };
 
 class DocumentProcessor
@@ -108,17 +145,79 @@ public:
   QSharedPointer<Environment> root() const;
 
   void process(const QDir & directory);
+  QStringList listFiles(const QDir & directory) const;
+
+  inline DirectoryWalker & directoryWalker() { return mDirectoryWalker; }
+  void processFiles(const QStringList & files);
+
+  struct Statistics
+  {
+    int processedFiles = 0;
+    int skippedFiles = 0;
+    int cachedFiles = 0; // processed files whose contribution was read from the cache
+  };
+
+  inline const Statistics & statistics() const { return mStatistics; }
+
+  struct PreparedFile
+  {
+    QString path;
+    bool opened = false;
+    bool skipped = false; // the file cannot contain any block
+    QString content;
+    const BlockScanner *scanner = nullptr;
+    QVector<BlockScanner::Block> blocks;
+    QVector<StreamTokenizer::Lexeme> lexemes; // tokens of the blocks, if tokenized ahead
+    std::exception_ptr error; // set if the file could not be prepared on another thread
+  };
+
+  struct FileType
+  {
+    QString patterns;
+    QList<QRegExp> globs;
+    BlockScanner scanner;
+  };
+
+  /* A copy of the block delimiters, owned by the thread that uses it */
+  struct Scanners
+  {
+    QList<FileType> fileTypes;
+    BlockScanner fallback;
+    QChar escape;
+
+    const BlockScanner & get(const QString & filename) const;
+  };
+
+  Scanners scanners() const;
+
+  PreparedFile prepareFile(const QString & path, bool tokenize) const;
+  static PreparedFile prepareFile(const QString & path, bool tokenize, const Scanners & scanners);
+
+  void setTokenizeAhead(bool on);
+  inline bool tokenizeAhead() const { return mTokenizeAhead; }
+
+  inline FileCache* cache() const { return mCache; }
+  void setCache(FileCache *cache);
+
+  void setReadAhead(int files, qint64 memory);
+  inline int readAheadFiles() const { return mReadAheadFiles; }
+  inline qint64 readAheadMemory() const { return mReadAheadMemory; }
 
   QSharedPointer<Environment> getEnvironment(const QString & name) const;
   void enter(const QSharedPointer<Environment> & env);
   void leave();
 
   void input(const QString & filename);
+  QString readRawEnvironment(const QString & name);
 
   static void registerApi(script::Engine *e);
 
   void setBlockDelimiters(const QString & start, const QString & end);
+  void addBlockDelimiters(const QString & patterns, const QString & start, const QString & end);
+  const BlockScanner & blockScanner(const QString & filename) const;
   void addIgnoredSequence(const QString & val);
+  void setTextCoalescing(bool on);
+  inline bool textCoalescing() const { return mTextCoalescing; }
 
   static bool isSpace(const json::Json& node);
   static bool isWord(const json::Json& node) { return node.isString(); }
@@ -130,11 +229,12 @@ public:
   QString stringify(const json::Json& data);
 
 protected:
-  json::Json read();
-  json::Json readArgument();
+  Node read();
+  Node readArgument();
   json::Json readLineArgument();
   json::Json readParagraphArgument();
-  json::Json createNode(const StreamTokenizer::Token & tok);
+  QString readRawArgument();
+  Node createNode(const StreamTokenizer::Token & tok);
   json::Json readGroup(const StreamTokenizer::Token & tok);
   Options readOptions();
   static json::Json parseOptions(const QString& val);
@@ -142,21 +242,52 @@ protected:
   json::Json readCommand(const StreamTokenizer::Token & command);
 
   void processFile(const QString & path);
+  void processFile(const PreparedFile & file);
+  void processCachedFile(const PreparedFile & file);
+  void parse(const PreparedFile & file);
 
   bool seekBlock();
   bool atBlockEnd() const;
   void beginLine();
 
+  void updateLookupTable() const;
+
+  void dispatch(const Node & node);
+  void deliver(const Node & node);
+  void flushTextRun();
+  void flushBatch();
+  void flushPendingNodes();
+
   script::Engine* engine() const;
 
 private:
   InputStream mInputStream;
   StreamTokenizer mTokenizer;
-  QPair<QString, QString> mBlockDelimiter;
+  BlockScanner mBlockScanner;
+  DirectoryWalker mDirectoryWalker;
+  QList<FileType> mFileTypes;
+  const BlockScanner *mCurrentScanner;
+  QVector<BlockScanner::Block> mBlocks;
+  int mCurrentBlock;
   QStringList mIgnoredSequences;
+  WordTable mWords;
+  json::Array mPendingNodes;
+  bool mTextCoalescing;
+  bool mTokenizeAhead;
+  int mReadAheadFiles;
+  qint64 mReadAheadMemory;
+  Node mTextRun;
   dex::State *mState;
+  FileCache *mCache;
+  QStringList mInputs; // files pulled in with \input by the current file
   QDir mCurrentDir;
   QStack<QSharedPointer<Environment>> mEnvironments;
+  // commands and environments visible from the top of mEnvironments,
+  // rebuilt lazily after enter() or leave()
+  mutable QHash<QString, QSharedPointer<Command>> mCommandTable;
+  mutable QHash<QString, QSharedPointer<Environment>> mEnvironmentTable;
+  mutable bool mLookupTableValid;
+  Statistics mStatistics;
 };
 
 } // namespace dex
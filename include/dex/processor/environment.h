@@ -5,8 +5,10 @@
 #ifndef DEX_ENVIRONMENT_H
 #define DEX_ENVIRONMENT_H
 
+#include <QHash>
 #include <QList>
 #include <QSharedPointer>
+#include <QString>
 
 namespace script
 {
@@ -28,13 +30,26 @@ public:
   virtual void enter(const Options& options) = 0;
   virtual void leave() = 0;
 
+  virtual bool isRaw() const;
+  virtual void enterRaw(const Options& options, const QString & content);
+
   QSharedPointer<Command> getCommand(const QString & name) const;
   QSharedPointer<Environment> getEnvironment(const QString & name) const;
 
+  void addCommand(const QSharedPointer<Command> & com);
+  void addEnvironment(const QSharedPointer<Environment> & env);
+
+  inline const QList<QSharedPointer<Command>> & commands() const { return mCommands; }
+  inline const QList<QSharedPointer<Environment>> & environments() const { return mEnvironments; }
+
   static QSharedPointer<Environment> build(const script::Namespace & ns);
 
-  QList<QSharedPointer<Environment>> environments;
-  QList<QSharedPointer<Command>> commands;
+private:
+  QList<QSharedPointer<Environment>> mEnvironments;
+  QList<QSharedPointer<Command>> mCommands;
+  // name -> first element of the corresponding list with that name
+  QHash<QString, QSharedPointer<Command>> mCommandIndex;
+  QHash<QString, QSharedPointer<Environment>> mEnvironmentIndex;
 };
 
 } // namespace dex
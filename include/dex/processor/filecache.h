@@ -0,0 +1,69 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_FILE_CACHE_H
+#define DEX_FILE_CACHE_H
+
+#include "dex/core/json.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QString>
+#include <QVector>
+
+namespace dex
+{
+
+/*!
+ * \class FileCache
+ * \brief Stores on disk the contribution of each input file to the State.
+ *
+ * An entry is valid as long as the content of the file, the content of
+ * the files it pulled in with \input, the profile, the version of dex
+ * and the ids of the builtin types are unchanged.
+ * There is one entry per input file, so that an entry is overwritten
+ * rather than accumulated when its file changes.
+ *
+ * A file that is not in the cache is parsed with the List members of the
+ * State emptied, as each worker of --jobs is, so that its contribution is
+ * what it appended to them. As with --jobs, the output is the same as
+ * without the cache only if the commands do not read or modify what other
+ * files added. The cache is not used if the State is not merged list by
+ * list (see State::isMergedByLists()).
+ *
+ * Entries of different files can be read and written concurrently.
+ */
+class FileCache
+{
+public:
+  FileCache(const QDir & directory, const QByteArray & profileHash);
+
+  inline const QDir & directory() const { return mDirectory; }
+  inline const QByteArray & profileHash() const { return mProfileHash; }
+
+  struct Dependency
+  {
+    QString path;
+    QByteArray hash;
+  };
+
+  bool lookup(const QString & path, const QByteArray & contentHash, json::Json & contribution) const;
+  void store(const QString & path, const QByteArray & contentHash, const QVector<Dependency> & inputs, const json::Json & contribution) const;
+
+  static QByteArray typesHash();
+  static QByteArray hash(const QString & content);
+  static QByteArray hashFile(const QString & path);
+  static QByteArray hashDirectory(const QDir & directory);
+
+protected:
+  QString entryPath(const QString & path) const;
+
+private:
+  QDir mDirectory;
+  QByteArray mProfileHash;
+};
+
+} // namespace dex
+
+#endif // DEX_FILE_CACHE_H
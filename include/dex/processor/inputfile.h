@@ -0,0 +1,53 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_INPUT_FILE_H
+#define DEX_INPUT_FILE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+namespace dex
+{
+
+/*!
+ * \class InputFile
+ * \brief Provides read-only access to the raw bytes of an input file.
+ *
+ * Regular files are memory-mapped so that their content can be decoded
+ * directly from the mapping; pipes, special files and files that cannot
+ * be mapped are read into a buffer instead.
+ */
+class InputFile
+{
+public:
+  explicit InputFile(const QString & path);
+  InputFile(const InputFile & other) = delete;
+  ~InputFile();
+
+  inline QString path() const { return mFile.fileName(); }
+
+  bool open();
+  void close();
+
+  inline bool isOpen() const { return mFile.isOpen(); }
+  inline bool isMapped() const { return mMapping != nullptr; }
+
+  const char* data() const;
+  int size() const;
+
+  QString decode() const;
+
+  InputFile & operator=(const InputFile & other) = delete;
+
+private:
+  QFile mFile;
+  uchar *mMapping;
+  QByteArray mBuffer;
+};
+
+} // namespace dex
+
+#endif // DEX_INPUT_FILE_H
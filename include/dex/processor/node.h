@@ -0,0 +1,94 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_NODE_H
+#define DEX_NODE_H
+
+#include "dex/core/json.h"
+
+#include <QMultiHash>
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+namespace dex
+{
+
+/*!
+ * \class Node
+ * \brief Compact representation of a node produced by the DocumentProcessor.
+ *
+ * Words and spaces only reference the text of the document they were read
+ * from; a json::Json is created when the node is passed to a script.
+ * Each conversion creates a new json::Json, as scripts may modify the
+ * nodes they receive; runs of up to eight spaces share their string.
+ */
+class Node
+{
+public:
+  enum Kind {
+    Null = 0,
+    Word,
+    Space,
+    EOL,
+    Group,
+    Other,
+  };
+
+  Node();
+  Node(Kind k, const QString & source, int offset, int length);
+  Node(Kind k, const json::Json & value);
+
+  static Node fromJson(const json::Json & value);
+
+  inline Kind kind() const { return mKind; }
+  inline bool isNull() const { return mKind == Null; }
+  inline bool isWord() const { return mKind == Word; }
+  inline bool isSpace() const { return mKind == Space; }
+  inline bool isEOL() const { return mKind == EOL; }
+
+  inline QStringRef text() const { return QStringRef(&mSource, mOffset, mLength); }
+
+  bool extend(const Node & other);
+
+  json::Json toJson() const;
+
+  static json::Json createSpace(const QString & text);
+  static json::Json createEOL();
+
+private:
+  Kind mKind;
+  QString mSource;
+  int mOffset;
+  int mLength;
+  json::Json mValue;
+};
+
+/*!
+ * \class WordTable
+ * \brief Deduplicates the text of the words read from a file.
+ *
+ * Each distinct word is copied out of the document only once; later
+ * occurrences share that string. Every occurrence still gets its own
+ * json::Json, so that modifying one node does not modify the others.
+ * The table is cleared when the file has been processed. Strings that
+ * were handed to scripts remain valid, as QString is reference-counted.
+ */
+class WordTable
+{
+public:
+  WordTable() = default;
+
+  json::Json toJson(const Node & n);
+
+  void clear();
+
+private:
+  QMultiHash<uint, int> mIndex;
+  QVector<QString> mEntries;
+};
+
+} // namespace dex
+
+#endif // DEX_NODE_H
@@ -0,0 +1,61 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_PREFETCHER_H
+#define DEX_PREFETCHER_H
+
+#include "dex/core/spscqueue.h"
+#include "dex/processor/documentprocessor.h"
+
+#include <QAtomicInteger>
+#include <QStringList>
+#include <QThread>
+
+namespace dex
+{
+
+/*!
+ * \class Prefetcher
+ * \brief Reads and tokenizes files ahead of the DocumentProcessor.
+ *
+ * The prepared files are passed to the consumer through a bounded queue,
+ * in the order of the list of files; take() must be called exactly once
+ * per file.
+ * Besides the number of files, the memory held by the queued files is
+ * bounded: a file is only queued if it fits in the budget, or if the
+ * queue is empty.
+ * Files pulled in with \input are not known in advance and are still
+ * tokenized by the consumer.
+ * Files are not tokenized ahead when the processor has a cache, as most
+ * of them are then answered from the cache without being parsed.
+ *
+ * The block delimiters are copied when the prefetcher is created.
+ * If a file cannot be prepared, the exception is rethrown by take() and
+ * no further file is prepared.
+ */
+class Prefetcher : public QThread
+{
+public:
+  Prefetcher(const DocumentProcessor & processor, const QStringList & files, int capacity, qint64 memory);
+  ~Prefetcher();
+
+  DocumentProcessor::PreparedFile take();
+
+  void stop();
+
+protected:
+  void run() override;
+
+private:
+  DocumentProcessor::Scanners mScanners;
+  bool mTokenize;
+  QStringList mFiles;
+  SpscQueue<DocumentProcessor::PreparedFile> mQueue;
+  qint64 mMemoryBudget;
+  QAtomicInteger<qint64> mQueuedMemory;
+};
+
+} // namespace dex
+
+#endif // DEX_PREFETCHER_H
@@ -6,10 +6,19 @@
 #define DEX_STATE_H
 
 #include "dex/core/json.h"
+#include "dex/core/value.h"
+#include "dex/processor/node.h"
 
 #include <script/function.h>
 #include <script/value.h>
 
+#include <QVector>
+
+namespace script
+{
+class Class;
+} // namespace script
+
 namespace dex
 {
 
@@ -22,14 +31,7 @@ public:
 
   State(const script::Value & val);
 
-  struct TypeInfo {
-    script::Type type;
-  };
-
-  static TypeInfo static_type_info;
-  inline static TypeInfo & type_info() { return static_type_info; }
-
-  static State create(script::Engine *e);
+  static State create(const script::Class & state_class);
 
   inline script::Engine* engine() const { return mValue.engine(); }
 
@@ -41,8 +43,18 @@ public:
   void beginBlock();
   void endBlock();
 
+  bool accepts(Node::Kind kind) const;
   void dispatch(const json::Json& node);
 
+  inline bool acceptsBatches() const { return !mDispatchBatch.isNull(); }
+  void dispatchBatch(const json::Array& nodes);
+
+  void merge(const State & other);
+  bool isMergedByLists() const;
+
+  QVector<QList<dex::Value>> detachLists();
+  void reattachLists(QVector<QList<dex::Value>> & lists);
+
   void destroy();
 
   State & operator=(const State & ) = default;
@@ -58,6 +70,12 @@ private:
   script::Function mBeginBlock;
   script::Function mEndBlock;
   script::Function mDispatch;
+  script::Function mDispatchBatch;
+  script::Function mMerge;
+  QVector<int> mNodeFilters;
+
+  void readNodeFilters(const script::Function & f);
+  QVector<QList<dex::Value>*> listMembers() const;
 };
 
 } // namespace dex
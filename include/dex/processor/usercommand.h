@@ -10,6 +10,8 @@
 #include <script/function.h>
 #include <script/value.h>
 
+#include <QVector>
+
 namespace dex
 {
 
@@ -32,10 +34,25 @@ public:
 
   static QSharedPointer<UserCommand> create(const script::Class & cla);
 
+protected:
+  void compile();
+
+  typedef script::Value(*ArgumentConverter)(script::Engine*, const json::Json&, const script::Type&);
+  typedef json::Json(*ResultConverter)(const script::Value&);
+
 private:
   QString mName;
   script::Value mObject;
   script::Function mFunction;
+
+  /* Invocation plan, computed once from the prototype of mFunction */
+  int mParameterCount;
+  CommandSpan::Value mSpan;
+  bool mAcceptsOptions;
+  int mFirstArgument;
+  QVector<script::Type> mParameterTypes;
+  QVector<ArgumentConverter> mConverters;
+  ResultConverter mResultConverter;
 };
 
 } // namespace dex
@@ -22,6 +22,9 @@ public:
   void enter(const Options& opts) override;
   void leave() override;
 
+  bool isRaw() const override;
+  void enterRaw(const Options& opts, const QString & content) override;
+
 private:
   script::Function mEnterFunction;
   script::Function mLeaveFunction;
@@ -0,0 +1,14 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DEX_VERSION_H
+#define DEX_VERSION_H
+
+#define DEX_VERSION_MAJOR 0
+#define DEX_VERSION_MINOR 1
+#define DEX_VERSION_PATCH 0
+
+#define DEX_VERSION_STRING "0.1.0"
+
+#endif // DEX_VERSION_H
@@ -4,6 +4,9 @@
 
 #include "dex/api/file.h"
 
+#include "dex/context.h"
+#include "dex/core/output.h"
+
 #include <script/class.h>
 #include <script/classbuilder.h>
 #include <script/constructorbuilder.h>
@@ -16,11 +19,14 @@
 #include <script/interpreter/executioncontext.h>
 #include <script/private/value_p.h>
 
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <QDebug>
+
 namespace dex
 {
 
-File::TypeInfo File::static_type_info = File::TypeInfo{};
-
 namespace callbacks
 {
 
@@ -109,6 +115,14 @@ static script::Value write(script::FunctionCall *c)
   return script::Value::Void;
 }
 
+static script::Value write_if_changed(script::FunctionCall *c)
+{
+  dex::Context *context = dex::Context::get(c->engine());
+  Output *output = context != nullptr ? context->output() : nullptr;
+  const bool written = File::writeIfChanged(c->arg(0).toString(), c->arg(1).toString().toUtf8(), output);
+  return c->engine()->newBool(written);
+}
+
 } // namespace callbacks
 
 
@@ -128,8 +142,7 @@ void File::register_type(script::Namespace ns)
 {
   using namespace script;
 
-  Class file = ns.newClass("File").setFinal(true).get();
-  type_info().type = file.id();
+  Class file = ns.newClass("File").setId(Type::DexFile).setFinal(true).get();
   register_open_mode_flag(file);
 
   file.newConstructor(callbacks::ctor).create();
@@ -180,6 +193,50 @@ void File::register_type(script::Namespace ns)
   file.newMethod("write", callbacks::write)
     .params(Type::cref(Type::String))
     .create();
+
+  ns.newFunction("writeIfChanged", callbacks::write_if_changed)
+    .returns(Type::Boolean)
+    .params(Type::cref(Type::String), Type::cref(Type::String))
+    .create();
+}
+
+/*!
+ * \fn bool File::writeIfChanged(const QString & path, const QByteArray & content, Output *output)
+ * \brief Writes a file unless it already has the given content.
+ *
+ * An unchanged file is not opened for writing, so that its modification
+ * time is preserved. The file on disk is always compared, so that a file
+ * modified by other means is rewritten.
+ * The file is recorded in the manifest of \a output (if not null), so
+ * that it can be pruned once it is no longer written.
+ * Returns true if the file was written.
+ */
+bool File::writeIfChanged(const QString & path, const QByteArray & content, Output *output)
+{
+  const QFileInfo info{ path };
+
+  bool unchanged = info.exists() && info.size() == content.size();
+
+  if (unchanged)
+  {
+    QFile f{ path };
+    unchanged = f.open(QIODevice::ReadOnly) && f.readAll() == content;
+  }
+
+  if (output != nullptr)
+    output->recordFile(path);
+
+  if (unchanged)
+    return false;
+
+  QSaveFile f{ path };
+  if (!f.open(QIODevice::WriteOnly) || f.write(content) != content.size() || !f.commit())
+  {
+    qDebug() << "Could not write output file:" << path;
+    return false;
+  }
+
+  return true;
 }
 
 QFile & File::get(const script::Value & val)
@@ -4,6 +4,7 @@
 
 #include "dex/api/liquid.h"
 
+#include "dex/context.h"
 #include "dex/core/output.h"
 #include "dex/core/serialization.h"
 
@@ -155,7 +156,7 @@ void LiquidRenderer::init(const script::Value& s)
 
 QString LiquidRenderer::stringify(const json::Json& val)
 {
-  return dex::Output::current()->stringify(val);
+  return dex::Context::get(m_self.engine())->output()->stringify(val);
 }
 
 json::Json LiquidRenderer::applyFilter(const QString& name, const json::Json& object, const std::vector<json::Json>& args)
@@ -179,11 +180,11 @@ json::Json LiquidRenderer::applyFilter(const QString& name, const json::Json& ob
   }
   
 
-  engine_args.push(dex::serialization::deserialize(object, script::Type::Auto));
+  engine_args.push(dex::serialization::deserialize(engine, object, script::Type::Auto));
 
   for (const auto& a : args)
   {
-    engine_args.push(dex::serialization::deserialize(a, script::Type::Auto));
+    engine_args.push(dex::serialization::deserialize(engine, a, script::Type::Auto));
   }
 
   script::Value result = filter.call(engine_args);
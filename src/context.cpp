@@ -0,0 +1,102 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/context.h"
+
+#include "dex/core/output.h"
+#include "dex/core/value.h"
+#include "dex/processor/filecache.h"
+
+#include <QHash>
+#include <QReadLocker>
+#include <QReadWriteLock>
+#include <QWriteLocker>
+
+namespace dex
+{
+
+static QReadWriteLock & registry_lock()
+{
+  static QReadWriteLock lock;
+  return lock;
+}
+
+static QHash<script::Engine*, Context*> & registry()
+{
+  static QHash<script::Engine*, Context*> contexts;
+  return contexts;
+}
+
+Context::Context()
+  : mDocumentProcessor(new DocumentProcessor{})
+  , mOutput(nullptr)
+{
+  QWriteLocker lock{ &registry_lock() };
+  registry().insert(&mEngine, this);
+}
+
+Context::~Context()
+{
+  // the outputs and the state hold values that belong to the engine
+  mOutput = nullptr;
+  mOutputs.clear();
+
+  if (!mState.get().isNull())
+    mState.destroy();
+
+  ValueTypeInfo::purge(&mEngine);
+
+  QWriteLocker lock{ &registry_lock() };
+  registry().remove(&mEngine);
+}
+
+void Context::setState(const dex::State & state)
+{
+  mState = state;
+}
+
+void Context::addOutput(std::unique_ptr<Output> && output)
+{
+  mOutputs.push_back(std::move(output));
+}
+
+void Context::setOutput(Output *output)
+{
+  mOutput = output;
+}
+
+void Context::setProfileDirectory(const QDir & dir)
+{
+  if (dir.absolutePath() != mProfileDirectory.absolutePath())
+    mProfileHash.clear();
+
+  mProfileDirectory = dir;
+}
+
+/*!
+ * \fn const QByteArray & Context::profileHash()
+ * \brief Returns a hash of the content of the profile directory.
+ *
+ * The hash is computed on first use and kept for the lifetime of the
+ * context, as the profile is not expected to change during a run.
+ */
+const QByteArray & Context::profileHash()
+{
+  if (mProfileHash.isEmpty())
+    mProfileHash = FileCache::hashDirectory(mProfileDirectory);
+
+  return mProfileHash;
+}
+
+/*!
+ * \fn Context* Context::get(script::Engine *e)
+ * \brief Returns the context owning the given engine.
+ */
+Context* Context::get(script::Engine *e)
+{
+  QReadLocker lock{ &registry_lock() };
+  return registry().value(e, nullptr);
+}
+
+} // namespace dex
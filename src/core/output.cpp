@@ -6,6 +6,8 @@
 
 #include "dex/core/serialization.h"
 
+#include "dex/context.h"
+
 #include <script/class.h>
 #include <script/engine.h>
 
@@ -18,6 +20,11 @@
 #include <script/typesystem.h>
 #include <script/interpreter/executioncontext.h>
 
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
 namespace script
 {
 
@@ -32,7 +39,8 @@ namespace output_callbacks
 Value stringify(FunctionCall* c)
 {
   json::Json& data = get<json::Json>(c->arg(0));
-  return c->engine()->newString(dex::Output::current()->stringify(data));
+  dex::Output *output = dex::Context::get(c->engine())->output();
+  return c->engine()->newString(output->stringify(data));
 }
 
 /*!
@@ -50,6 +58,32 @@ Value stringify(FunctionCall* c)
  * functions to convert its input to a String.
  */
 
+/*!
+ * \fn bool isUpToDate(const String& page, const String& digest)
+ * \brief Returns whether a page was rendered from the same inputs by the previous run.
+ *
+ * The digest should be computed with serialization::digest() from
+ * everything the page is rendered from (template and context).
+ * If true is returned, the page is kept as is and need not be rendered;
+ * otherwise the page must be written and then passed to setRendered().
+ */
+Value is_up_to_date(FunctionCall* c)
+{
+  dex::Output *output = dex::Context::get(c->engine())->output();
+  return c->engine()->newBool(output->isUpToDate(c->arg(1).toString(), c->arg(2).toString()));
+}
+
+/*!
+ * \fn void setRendered(const String& page, const String& digest)
+ * \brief Records the digest of the inputs a page was rendered from.
+ */
+Value set_rendered(FunctionCall* c)
+{
+  dex::Output *output = dex::Context::get(c->engine())->output();
+  output->setRendered(c->arg(1).toString(), c->arg(2).toString());
+  return Value::Void;
+}
+
 /*!
  * \fn Output()
  * \brief Default constructor
@@ -78,8 +112,6 @@ Value dtor(FunctionCall* c)
 namespace dex
 { 
 
-Output* Output::staticCurrentOutput = nullptr;
-
 Output::Output(const script::Value& impl)
   : m_self(impl)
 {
@@ -166,7 +198,7 @@ QString Output::stringify(const json::Json& data)
     }
   }
 
-  script::Value val = dex::serialization::deserialize(data, script::Type::Auto);
+  script::Value val = dex::serialization::deserialize(m_self.engine(), data, script::Type::Auto);
   QString result = stringify(val);
   m_self.engine()->destroy(val);
   return result;
@@ -213,7 +245,7 @@ QString Output::stringify(const script::Value& val)
 
 QString Output::stringify(const json::Array& data, const script::Function& /* to_string */)
 {
-  script::Value val = dex::serialization::deserialize(data, script::Type::JsonArray);
+  script::Value val = dex::serialization::deserialize(m_self.engine(), data, script::Type::JsonArray);
   QString result = stringify(val);
   m_self.engine()->destroy(val);
   return result;
@@ -221,7 +253,7 @@ QString Output::stringify(const json::Array& data, const script::Function& /* to
 
 QString Output::stringify(const json::Object& data, const script::Function& /* to_string */)
 {
-  script::Value val = dex::serialization::deserialize(data, script::Type::JsonObject);
+  script::Value val = dex::serialization::deserialize(m_self.engine(), data, script::Type::JsonObject);
   QString result = stringify(val);
   m_self.engine()->destroy(val);
   return result;
@@ -231,17 +263,142 @@ void Output::write(const QString& outdir)
 {
   script::Engine* e = m_self.engine();
 
+  loadManifest(outdir, dex::Context::get(e)->profileHash());
+
   script::Locals args;
 
   args.push(m_self);
   args.push(e->newString(outdir));
 
   m_write.call(args);
+
+  pruneStaleFiles();
+  saveManifest();
+}
+
+bool Output::isUpToDate(const QString& page, const QString& digest)
+{
+  const QString key = QDir{ m_outdir }.relativeFilePath(page);
+
+  if (m_previous_digests.value(key) != digest || !QFileInfo::exists(page))
+    return false;
+
+  m_digests[key] = digest;
+
+  if (m_previous_files.contains(key))
+    m_files.insert(key);
+
+  return true;
 }
 
-Output* Output::current()
+void Output::setRendered(const QString& page, const QString& digest)
 {
-  return staticCurrentOutput;
+  m_digests[QDir{ m_outdir }.relativeFilePath(page)] = digest;
+}
+
+void Output::recordFile(const QString& path)
+{
+  if (m_outdir.isEmpty())
+    return;
+
+  // files outside of the output directory are never pruned
+  const QString key = QDir{ m_outdir }.relativeFilePath(path);
+  if (key.startsWith("../") || QDir::isAbsolutePath(key))
+    return;
+
+  m_files.insert(key);
+}
+
+/*!
+ * \fn void Output::pruneStaleFiles()
+ * \brief Removes the files written by the previous run that were neither written nor kept by this one.
+ *
+ * Only files recorded in the manifest are considered, so files that were
+ * not produced by dex are never removed.
+ */
+void Output::pruneStaleFiles()
+{
+  const QDir dir{ m_outdir };
+
+  for (const QString& file : m_previous_files)
+  {
+    if (!m_files.contains(file))
+      dir.remove(file);
+  }
+}
+
+static QString manifest_path(const QString& outdir)
+{
+  return QDir{ outdir }.filePath(".dex-manifest.json");
+}
+
+/*!
+ * \fn void Output::loadManifest(const QString& outdir, const QByteArray& profileHash)
+ * \brief Reads the manifest written by the previous run in \a outdir.
+ *
+ * The list of files written by the previous run is always read, so that
+ * they can be pruned. The digests of the pages are discarded if the
+ * output or the profile changed since, as the way pages are rendered
+ * from their inputs is defined by the profile.
+ */
+void Output::loadManifest(const QString& outdir, const QByteArray& profileHash)
+{
+  m_outdir = outdir;
+  m_previous_digests.clear();
+  m_digests.clear();
+  m_previous_files.clear();
+  m_files.clear();
+
+  m_profile_digest = QString::fromLatin1(profileHash);
+
+  QFile f{ manifest_path(outdir) };
+  if (!f.open(QIODevice::ReadOnly))
+    return;
+
+  const json::Json manifest = dex::serialization::fromJsonText(f.readAll());
+
+  if (!manifest.isObject())
+    return;
+
+  const json::Json files = manifest["files"];
+  if (files.isArray())
+  {
+    for (int i(0); i < files.length(); ++i)
+      m_previous_files.insert(files.at(i).toString());
+  }
+
+  if (manifest["output"].toString() != name() || manifest["profile"].toString() != m_profile_digest)
+    return;
+
+  for (const auto& page : manifest["pages"].toObject().data())
+    m_previous_digests[page.first] = page.second.toString();
+}
+
+void Output::saveManifest()
+{
+  json::Object pages;
+  for (auto it = m_digests.begin(); it != m_digests.end(); ++it)
+    pages[it.key()] = it.value();
+
+  QStringList paths = m_files.toList();
+  paths.sort();
+
+  json::Array files;
+  for (const QString& path : paths)
+    files.push(path);
+
+  json::Object manifest;
+  manifest["output"] = name();
+  manifest["profile"] = m_profile_digest;
+  manifest["pages"] = pages;
+  manifest["files"] = files;
+
+  QSaveFile f{ manifest_path(m_outdir) };
+  if (!f.open(QIODevice::WriteOnly))
+    return;
+
+  f.write(dex::serialization::toJsonText(manifest));
+  f.commit();
 }
 
 void Output::expose(script::Namespace& ns)
@@ -251,6 +408,15 @@ void Output::expose(script::Namespace& ns)
   output.newConstructor(script::output_callbacks::ctor).create();
   output.newDestructor(script::output_callbacks::dtor).create();
 
+  output.newMethod("isUpToDate", script::output_callbacks::is_up_to_date)
+    .returns(script::Type::Boolean)
+    .params(script::Type::cref(script::Type::String), script::Type::cref(script::Type::String))
+    .create();
+
+  output.newMethod("setRendered", script::output_callbacks::set_rendered)
+    .params(script::Type::cref(script::Type::String), script::Type::cref(script::Type::String))
+    .create();
+
   ns.newFunction("stringify", script::output_callbacks::stringify)
     .returns(script::Type::String)
     .params(script::make_type<const json::Json&>())
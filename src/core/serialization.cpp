@@ -4,7 +4,6 @@
 
 #include "dex/core/serialization.h"
 
-#include "dex/dex.h"
 #include "dex/core/list.h"
 #include "dex/core/ref.h"
 #include "dex/core/value.h"
@@ -25,6 +24,15 @@
 #include <script/templatebuilder.h>
 #include <script/typesystem.h>
 
+#include <QCryptographicHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+
+#include <cmath>
+#include <limits>
+
 namespace script
 {
 
@@ -40,7 +48,13 @@ static script::Value decode(script::FunctionCall* c)
 {
   const json::Json& data = get<json::Json>(c->arg(0));
   const script::Type t = c->callee().returnType();
-  return dex::serialization::deserialize(data, t);
+  return dex::serialization::deserialize(c->engine(), data, t);
+}
+
+static script::Value digest(script::FunctionCall* c)
+{
+  const json::Json& data = get<json::Json>(c->arg(0));
+  return c->engine()->newString(dex::serialization::digest(data));
 }
 
 static script::Value candecode(script::FunctionCall* c)
@@ -219,9 +233,8 @@ json::Json serialize(const script::Value& val)
   return serialize_object(val);
 }
 
-static bool perform_assignment(script::Value& lhs, const script::Value& rhs)
+static bool perform_assignment(script::Engine* e, script::Value& lhs, const script::Value& rhs)
 {
-  script::Engine* e = Dex::scriptEngine();
   auto lookup = script::NameLookup::resolve(script::AssignmentOperator, lhs.type(), rhs.type(), script::Scope(e->rootNamespace()));
 
   auto resol = script::OverloadResolution::New(e);
@@ -237,9 +250,8 @@ static bool perform_assignment(script::Value& lhs, const script::Value& rhs)
   return true;
 }
 
-static script::Value deserialize_object(const json::Json& json, script::Type type)
+static script::Value deserialize_object(script::Engine* e, const json::Json& json, script::Type type)
 {
-  script::Engine* e = Dex::scriptEngine();
   script::Value ret = e->construct(type, {});
   script::Object obj = ret.toObject();
   const script::Class cla = obj.instanceOf();
@@ -254,8 +266,8 @@ static script::Value deserialize_object(const json::Json& json, script::Type typ
     if (attr_index != -1)
     {
       script::Value attr = obj.at(attr_index);
-      script::Value newval = deserialize(member.second, attr.type());
-      perform_assignment(attr, newval);
+      script::Value newval = deserialize(e, member.second, attr.type());
+      perform_assignment(e, attr, newval);
       e->destroy(newval);
     }
     else
@@ -267,9 +279,8 @@ static script::Value deserialize_object(const json::Json& json, script::Type typ
   return ret;
 }
 
-static script::Value deserialize_ref(const json::Json& json, script::Class c)
+static script::Value deserialize_ref(script::Engine* e, const json::Json& json, script::Class c)
 {
-  script::Engine* e = Dex::scriptEngine();
 
   if (json.isNull())
   {
@@ -279,16 +290,14 @@ static script::Value deserialize_ref(const json::Json& json, script::Class c)
   script::Type T = c.arguments().front().type;
   script::Value ret = e->construct(script::Type(c.id()), {});
   dex::ValuePtr& ptr = script::get<dex::ValuePtr>(ret);
-  ptr = deserialize(json, T);
+  ptr = deserialize(e, json, T);
   return ret;
 }
 
-static script::Type deduceListType(const json::Array& vec);
+static script::Type deduceListType(script::Engine* e, const json::Array& vec);
 
-static script::Type deduceType(const json::Json& data)
+static script::Type deduceType(script::Engine* e, const json::Json& data)
 {
-  script::Engine* e = Dex::scriptEngine();
-
   if (data.isNull())
   {
     return script::Type::Null;
@@ -320,17 +329,15 @@ static script::Type deduceType(const json::Json& data)
   }
   else if (data.isArray())
   {
-    return deduceListType(data.toArray());
+    return deduceListType(e, data.toArray());
   }
 
   throw DeserializationError(data, script::Type::Auto);
 }
 
-static script::Type commonType(const json::Json& data, const script::Type& T)
+static script::Type commonType(script::Engine* e, const json::Json& data, const script::Type& T)
 {
-  script::Engine* e = Dex::scriptEngine();
-
-  const script::Type U = deduceType(data);
+  const script::Type U = deduceType(e, data);
 
   if (T == U)
   {
@@ -394,18 +401,18 @@ static script::Type commonType(const json::Json& data, const script::Type& T)
   throw DeserializationError(data, T);
 }
 
-script::Type deduceListType(const json::Array& vec)
+script::Type deduceListType(script::Engine* e, const json::Array& vec)
 {
   if (vec.length() == 0)
   {
     throw DeserializationError(vec, script::Type::Auto);
   }
 
-  script::Type T = deduceType(vec.at(0));
+  script::Type T = deduceType(e, vec.at(0));
 
   for (int i(1); i < vec.length(); ++i)
   {
-    T = commonType(vec.at(i), T);
+    T = commonType(e, vec.at(i), T);
   }
  
   if (T == script::Type::Auto)
@@ -416,9 +423,8 @@ script::Type deduceListType(const json::Array& vec)
   return T;
 }
 
-static script::Value deserialize_list(const json::Array& vec, script::Class c)
+static script::Value deserialize_list(script::Engine* e, const json::Array& vec, script::Class c)
 {
-  script::Engine* e = Dex::scriptEngine();
 
   script::Type T = c.arguments().front().type;
   script::Value ret = e->construct(script::Type(c.id()), {});
@@ -426,17 +432,15 @@ static script::Value deserialize_list(const json::Array& vec, script::Class c)
 
   for (int i(0); i < vec.length(); ++i)
   {
-    script::Value elem = deserialize(vec.at(i), T);
+    script::Value elem = deserialize(e, vec.at(i), T);
     list.push_back(dex::Value(elem, script::ParameterPolicy::Take));
   }
 
   return ret;
 }
 
-script::Value deserialize(const json::Json& json, script::Type type)
+script::Value deserialize(script::Engine* e, const json::Json& json, script::Type type)
 {
-  script::Engine* e = Dex::scriptEngine();
-  
   if (json.isBoolean()
     && (type.baseType() == script::Type::Boolean || type == script::Type::Auto))
   {
@@ -479,25 +483,25 @@ script::Value deserialize(const json::Json& json, script::Type type)
 
     if (cla.isTemplateInstance() && cla.instanceOf() == script::ClassTemplate::get<dex::RefTemplate>(e))
     {
-      return deserialize_ref(json, cla);
+      return deserialize_ref(e, json, cla);
     }
     else
     {
-      return deserialize_object(json, type);
+      return deserialize_object(e, json, type);
     }
   }
   else if ((type == script::Type::Auto || type.isObjectType()) && json.isArray())
   {
     if (type == script::Type::Auto)
     {
-      type = deduceListType(json.toArray());
+      type = deduceListType(e, json.toArray());
     }
 
     script::Class cla = e->typeSystem()->getClass(type);
 
     if (cla.isTemplateInstance() && cla.instanceOf() == script::ClassTemplate::get<dex::ListTemplate>(e))
     {
-      return deserialize_list(json.toArray(), cla);
+      return deserialize_list(e, json.toArray(), cla);
     }
   }
 
@@ -505,6 +509,119 @@ script::Value deserialize(const json::Json& json, script::Type type)
 }
 
 
+// QJsonDocument writes 2.0 as 2, which would be read back as an integer;
+// such numbers are wrapped in an object with a single "__double" member.
+static const QString double_key = "__double";
+
+static QJsonValue to_qt(const json::Json& json)
+{
+  if (json.isBoolean())
+    return json.toBool();
+  else if (json.isInteger())
+    return json.toInt();
+  else if (json.isNumber())
+  {
+    const double d = json.toNumber();
+    if (std::isfinite(d) && d == std::floor(d))
+      return QJsonObject{ { double_key, d } };
+    return d;
+  }
+  else if (json.isString())
+    return json.toString();
+  else if (json.isArray())
+  {
+    const json::Array vec = json.toArray();
+    QJsonArray result;
+    for (int i(0); i < vec.length(); ++i)
+      result.append(to_qt(vec.at(i)));
+    return result;
+  }
+  else if (json.isObject())
+  {
+    QJsonObject result;
+    for (const auto& member : json.toObject().data())
+      result.insert(member.first, to_qt(member.second));
+    return result;
+  }
+
+  return QJsonValue{};
+}
+
+static json::Json from_qt(const QJsonValue& val)
+{
+  switch (val.type())
+  {
+  case QJsonValue::Bool:
+    return val.toBool();
+  case QJsonValue::Double:
+  {
+    // QJsonValue does not distinguish integers from other numbers
+    const double d = val.toDouble();
+    if (std::isfinite(d) && d == std::floor(d) && d >= std::numeric_limits<int>::min() && d <= std::numeric_limits<int>::max())
+      return static_cast<int>(d);
+    return d;
+  }
+  case QJsonValue::String:
+    return val.toString();
+  case QJsonValue::Array:
+  {
+    json::Array result;
+    for (const auto& elem : val.toArray())
+      result.push(from_qt(elem));
+    return result;
+  }
+  case QJsonValue::Object:
+  {
+    const QJsonObject obj = val.toObject();
+    if (obj.size() == 1 && obj.value(double_key).isDouble())
+      return obj.value(double_key).toDouble();
+
+    json::Object result;
+    for (auto it = obj.begin(); it != obj.end(); ++it)
+      result[it.key()] = from_qt(it.value());
+    return result;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+/*!
+ * \fn QByteArray toJsonText(const json::Json& json)
+ * \brief Writes a json value as compact JSON text.
+ */
+QByteArray toJsonText(const json::Json& json)
+{
+  QJsonArray wrapper;
+  wrapper.append(to_qt(json));
+  return QJsonDocument(wrapper).toJson(QJsonDocument::Compact);
+}
+
+/*!
+ * \fn json::Json fromJsonText(const QByteArray& data)
+ * \brief Reads a json value written by toJsonText().
+ *
+ * Returns null if \a data is not valid.
+ */
+json::Json fromJsonText(const QByteArray& data)
+{
+  QJsonDocument doc = QJsonDocument::fromJson(data);
+
+  if (!doc.isArray() || doc.array().size() != 1)
+    return nullptr;
+
+  return from_qt(doc.array().at(0));
+}
+
+/*!
+ * \fn QString digest(const json::Json& json)
+ * \brief Returns a hash of a json value, suitable to detect changes between runs.
+ */
+QString digest(const json::Json& json)
+{
+  return QString::fromLatin1(QCryptographicHash::hash(toJsonText(json), QCryptographicHash::Sha1).toHex());
+}
+
 void expose(script::Namespace& ns)
 {
   script::Namespace s = ns.newNamespace("serialization");
@@ -523,6 +640,11 @@ void expose(script::Namespace& ns)
     .withBackend<script::CanDecodeTemplate>()
     .params(script::TemplateParameter(script::TemplateParameter::TypeParameter(), "T"))
     .create();
+
+  s.newFunction("digest", script::serialization_callbacks::digest)
+    .returns(script::Type::String)
+    .params(script::make_type<const json::Json&>())
+    .create();
 }
 
 } // namespace serialization
@@ -15,6 +15,8 @@
 #include <script/overloadresolution.h>
 #include <script/typesystem.h>
 
+#include <limits>
+
 namespace dex
 {
 
@@ -25,7 +27,11 @@ std::shared_ptr<ValueTypeInfo> ValueTypeInfo::get(const script::Function & f)
 
 std::shared_ptr<ValueTypeInfo> ValueTypeInfo::get(const script::Type & t, script::Engine *e)
 {
-  auto it = cache().find(t.baseType().data());
+  std::lock_guard<std::mutex> lock{ cache_mutex() };
+
+  const auto key = std::make_pair(e, t.baseType().data());
+
+  auto it = cache().find(key);
   if (it != cache().end())
     return it->second;
 
@@ -46,14 +52,37 @@ std::shared_ptr<ValueTypeInfo> ValueTypeInfo::get(const script::Type & t, script
     throw std::runtime_error{ "T must have operator==" };
   result->eq = resol.selectedOverload();
 
-  cache()[t.baseType().data()] = result;
+  cache()[key] = result;
 
   return result;
 }
 
-std::map<int, std::shared_ptr<ValueTypeInfo>> & ValueTypeInfo::cache()
+/*!
+ * \fn void ValueTypeInfo::purge(script::Engine *e)
+ * \brief Removes the cached entries of an engine that is about to be destroyed.
+ *
+ * Another engine may later be allocated at the same address.
+ */
+void ValueTypeInfo::purge(script::Engine *e)
+{
+  std::lock_guard<std::mutex> lock{ cache_mutex() };
+
+  auto & entries = cache();
+  auto it = entries.lower_bound(std::make_pair(e, std::numeric_limits<int>::min()));
+
+  while (it != entries.end() && it->first.first == e)
+    it = entries.erase(it);
+}
+
+std::map<std::pair<script::Engine*, int>, std::shared_ptr<ValueTypeInfo>> & ValueTypeInfo::cache()
+{
+  static std::map<std::pair<script::Engine*, int>, std::shared_ptr<ValueTypeInfo>> ret = {};
+  return ret;
+}
+
+std::mutex & ValueTypeInfo::cache_mutex()
 {
-  static std::map<int, std::shared_ptr<ValueTypeInfo>> ret = {};
+  static std::mutex ret;
   return ret;
 }
 
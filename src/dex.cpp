@@ -29,9 +29,11 @@
 #include <QDir>
 #include <QDirIterator>
 #include <QSettings>
+#include <QThread>
 
 #include <QDebug>
 
+#include <algorithm>
 #include <iostream>
 
 
@@ -48,21 +50,37 @@ script::Value dummy(script::FunctionCall *c)
 
 script::Value profile_directory(script::FunctionCall *c)
 {
-  return c->engine()->newString(qApp->activeProfileDir().absolutePath());
+  dex::Context *context = dex::Context::get(c->engine());
+  return c->engine()->newString(context->profileDirectory().absolutePath());
 }
 
 script::Value set_block_delimiters(script::FunctionCall *c)
 {
   QString left = c->arg(1).toString();
   QString right = c->arg(2).toString();
-  qApp->documentProcessor()->setBlockDelimiters(left, right);
+  dex::Context::get(c->engine())->documentProcessor()->setBlockDelimiters(left, right);
+  return script::Value::Void;
+}
+
+script::Value add_block_delimiters(script::FunctionCall *c)
+{
+  QString patterns = c->arg(1).toString();
+  QString left = c->arg(2).toString();
+  QString right = c->arg(3).toString();
+  dex::Context::get(c->engine())->documentProcessor()->addBlockDelimiters(patterns, left, right);
+  return script::Value::Void;
+}
+
+script::Value set_text_coalescing(script::FunctionCall *c)
+{
+  dex::Context::get(c->engine())->documentProcessor()->setTextCoalescing(c->arg(1).toBool());
   return script::Value::Void;
 }
 
 script::Value add_ignored_sequence(script::FunctionCall *c)
 {
   QString value = c->arg(1).toString();
-  qApp->documentProcessor()->addIgnoredSequence(value);
+  dex::Context::get(c->engine())->documentProcessor()->addIgnoredSequence(value);
   return script::Value::Void;
 }
 
@@ -73,35 +91,20 @@ script::Value add_ignored_sequence(script::FunctionCall *c)
 
 Application::CommandLineOptions::CommandLineOptions()
   : saveSettings(false)
+  , jobs(1)
+  , readAheadFiles(8)
+  , readAheadMemory(32)
+  , ignoreFiles(true)
 {
 
 }
 
 Application::Application(int & argc, char **argv)
-  : QApplication(argc, argv)
+  : QCoreApplication(argc, argv)
 {
-  mEngine.setup();
-
-  script::Namespace ns = mEngine.rootNamespace();
-
-  dex::Null::expose(ns);
-  dex::register_ref_template(ns);
-  dex::register_list_template(ns);
-
-  script::Namespace json_namespace = mEngine.rootNamespace().newNamespace("json");
-  dex::registerJsonTypes(json_namespace);
-  dex::Options::expose(ns);
-  dex::serialization::expose(ns);
-
-  dex::api::expose(&mEngine);
-
-  mEngine.rootNamespace().newFunction("profileDirectory", script::callbacks::profile_directory)
-    .returns(script::Type::String)
-    .create();
+  initContext(mContext);
 
   mSettings = new QSettings("dex.ini", QSettings::IniFormat, this);
-
-  mDocumentProcessor.reset(new dex::DocumentProcessor{});
 }
 
 Application::~Application()
@@ -127,15 +130,15 @@ int Application::run()
     setup();
     process(inputDirectory().absolutePath());
     output(outputDirectory().absolutePath());
-    mState.destroy();
+    mContext.state().destroy();
   }
   catch (std::runtime_error & ex)
   {
     qDebug() << "Fatal error:" << QString(ex.what());
     
-    if (!mState.get().isNull())
+    if (!mContext.state().get().isNull())
     {
-      mState.destroy();
+      mContext.state().destroy();
     }
 
     return 1;
@@ -154,41 +157,102 @@ void Application::setup()
     throw std::runtime_error{ "Profile dir does not exists" };
   }
 
-  fetchModules();
+  if (!mCliOptions.cacheDirectory.isEmpty())
+  {
+    mContext.setProfileDirectory(activeProfileDir());
+    mFileCache.reset(new dex::FileCache{ QDir{ mCliOptions.cacheDirectory }, mContext.profileHash() });
+  }
+
+  setupContext(mContext);
+}
+
+void Application::initContext(dex::Context & context)
+{
+  script::Engine *engine = context.engine();
+
+  engine->setup();
+
+  script::Namespace ns = engine->rootNamespace();
+
+  dex::Null::expose(ns);
+  dex::register_ref_template(ns);
+  dex::register_list_template(ns);
+
+  script::Namespace json_namespace = engine->rootNamespace().newNamespace("json");
+  dex::registerJsonTypes(json_namespace);
+  dex::Options::expose(ns);
+  dex::serialization::expose(ns);
+
+  dex::api::expose(engine);
+
+  engine->rootNamespace().newFunction("profileDirectory", script::callbacks::profile_directory)
+    .returns(script::Type::String)
+    .create();
+}
+
+void Application::setupContext(dex::Context & context)
+{
+  script::Engine *engine = context.engine();
+
+  context.setProfileDirectory(activeProfileDir());
+
+  context.documentProcessor()->setReadAhead(mCliOptions.readAheadFiles, qint64(mCliOptions.readAheadMemory) * 1024 * 1024);
+
+  dex::DirectoryWalker & walker = context.documentProcessor()->directoryWalker();
+  for (const auto & p : mCliOptions.includePatterns)
+    walker.addIncludePattern(p);
+  for (const auto & p : mCliOptions.excludePatterns)
+    walker.addExcludePattern(p);
+  for (const auto & e : mCliOptions.extensions)
+    walker.addExtension(e);
+  if (!mCliOptions.ignoreFiles)
+    walker.setIgnoreFiles(QStringList{});
 
-  script::Class parser = scriptEngine()->rootNamespace().newClass("Parser").get();
+  fetchModules(context);
+
+  script::Class parser = engine->rootNamespace().newClass("Parser").get();
   parser.newDestructor(script::callbacks::dummy).create();
   parser.newMethod("setBlockDelimiters", script::callbacks::set_block_delimiters)
     .setConst().params(script::Type::cref(script::Type::String), script::Type::cref(script::Type::String)).create();
+  parser.newMethod("addBlockDelimiters", script::callbacks::add_block_delimiters)
+    .setConst().params(script::Type::cref(script::Type::String), script::Type::cref(script::Type::String), script::Type::cref(script::Type::String)).create();
   parser.newMethod("addIgnoredSequence", script::callbacks::add_ignored_sequence)
     .setConst().params(script::Type::cref(script::Type::String)).create();
-  auto parser_value = scriptEngine()->construct(parser.id(), [](script::Value & val) -> void { });
-  scriptEngine()->manage(parser_value);
-  scriptEngine()->rootNamespace().addValue("parser_", parser_value);
+  parser.newMethod("setTextCoalescing", script::callbacks::set_text_coalescing)
+    .setConst().params(script::Type::Boolean).create();
+  auto parser_value = engine->construct(parser.id(), [](script::Value & val) -> void { });
+  engine->manage(parser_value);
+  engine->rootNamespace().addValue("parser_", parser_value);
+
+  dex::DocumentProcessor::registerApi(engine);
 
-  dex::DocumentProcessor::registerApi(scriptEngine());
+  dex::Output::expose(engine->rootNamespace());
 
-  dex::Output::expose(scriptEngine()->rootNamespace());
+  load_state(context);
 
-  load_state();
+  // A cached file is replayed by merging its contribution into the state,
+  // which can only reproduce a state that is merged list by list.
+  if (mFileCache != nullptr && !context.state().isMergedByLists())
+    qDebug() << "The State of the profile has a merge() function or data members that are not lists, --cache is ignored";
+  else
+    context.documentProcessor()->setCache(mFileCache.get());
 
-  mState = dex::State::create(scriptEngine());
-  scriptEngine()->rootNamespace().addValue("state", mState);
-  scriptEngine()->manage(mState);
+  engine->rootNamespace().addValue("state", context.state());
+  engine->manage(context.state());
 
-  scriptEngine()->getModule("commands").load();
+  engine->getModule("commands").load();
 
-  QDir commands = QDir{ activeProfileDir().absoluteFilePath("commands") };
+  QDir commands = QDir{ context.profileDirectory().absoluteFilePath("commands") };
   QList<script::Script> scripts;
   for (const auto & f : commands.entryInfoList())
   {
     if (f.suffix() != "dex")
       continue;
 
-    script::Script s = get_script(scriptEngine()->scripts(), f.absoluteFilePath().toUtf8().data());
+    script::Script s = get_script(engine->scripts(), f.absoluteFilePath().toUtf8().data());
     if (s.isNull())
     {
-      s = scriptEngine()->newScript(script::SourceFile{ f.absoluteFilePath().toUtf8().data() });
+      s = engine->newScript(script::SourceFile{ f.absoluteFilePath().toUtf8().data() });
       if (!s.compile())
       {
         qDebug() << "Failed to compile " << f.filePath();
@@ -202,21 +266,21 @@ void Application::setup()
   }
 
   for (const auto & s : scripts)
-    qSharedPointerCast<dex::RootEnvironment>(mDocumentProcessor->root())->fill(s);
+    qSharedPointerCast<dex::RootEnvironment>(context.documentProcessor()->root())->fill(s);
 
-  mState.init();
+  context.state().init();
 
-  load_outputs();
+  load_outputs(context);
 
-  for (const auto& o : mOutputs)
+  for (const auto& o : context.outputs())
   {
     if (o->name() == outputFormat())
     {
-      dex::Output::staticCurrentOutput = o.get();
+      context.setOutput(o.get());
     }
   }
 
-  if (dex::Output::staticCurrentOutput == nullptr)
+  if (context.output() == nullptr)
     throw std::runtime_error{ "Could not find valid output" };
 }
 
@@ -243,6 +307,30 @@ void Application::parserCommandLineArgs()
 
     if (args.at(i) == "--save-settings")
       mCliOptions.saveSettings = true;
+
+    if (args.at(i) == "-j" || args.at(i) == "--jobs")
+      mCliOptions.jobs = std::max(1, args.at(i + 1).toInt());
+
+    if (args.at(i) == "--read-ahead")
+      mCliOptions.readAheadFiles = std::max(0, args.at(i + 1).toInt());
+
+    if (args.at(i) == "--read-ahead-memory")
+      mCliOptions.readAheadMemory = std::min(1024, std::max(1, args.at(i + 1).toInt()));
+
+    if (args.at(i) == "--include")
+      mCliOptions.includePatterns += QDir::nameFiltersFromString(args.at(i + 1));
+
+    if (args.at(i) == "--exclude")
+      mCliOptions.excludePatterns += QDir::nameFiltersFromString(args.at(i + 1));
+
+    if (args.at(i) == "--ext")
+      mCliOptions.extensions += args.at(i + 1).split(',', QString::SkipEmptyParts);
+
+    if (args.at(i) == "--no-ignore-files")
+      mCliOptions.ignoreFiles = false;
+
+    if (args.at(i) == "--cache")
+      mCliOptions.cacheDirectory = args.at(i + 1);
   }
 
   if (mCliOptions.saveSettings)
@@ -272,18 +360,18 @@ static void fetch_module(script::Module& m, const QDir& dir)
   }
 }
 
-void Application::fetchModule(const QString& dirpath)
+void Application::fetchModule(dex::Context & context, const QString& dirpath)
 {
   QDir subdir{ dirpath };
-  script::Module m = scriptEngine()->newModule(subdir.dirName().toStdString());
+  script::Module m = context.engine()->newModule(subdir.dirName().toStdString());
   fetch_module(m, subdir);
 }
 
-void Application::fetchModules()
+void Application::fetchModules(dex::Context & context)
 {
-  qDebug() << "Fetching all modules in" << activeProfileDir().absolutePath();
+  qDebug() << "Fetching all modules in" << context.profileDirectory().absolutePath();
 
-  QDirIterator iterator{ activeProfileDir().absolutePath(), QDir::NoDotAndDotDot | QDir::Files | QDir::Dirs };
+  QDirIterator iterator{ context.profileDirectory().absolutePath(), QDir::NoDotAndDotDot | QDir::Files | QDir::Dirs };
 
   while (iterator.hasNext())
   {
@@ -291,23 +379,23 @@ void Application::fetchModules()
     QFileInfo info{ dirpath };
 
     if(info.isDir())
-      fetchModule(dirpath);
+      fetchModule(context, dirpath);
   }
 }
 
-static void register_state_type(Application &app, const script::Class &state)
+static void register_state_type(dex::Context & context, const script::Class &state)
 {
-  dex::State::type_info().type = state.id();
-
   if (!state.isDefaultConstructible())
     throw std::runtime_error{ "State class must be default constructible" };
+
+  context.setState(dex::State::create(state));
 }
 
-void Application::load_state()
+void Application::load_state(dex::Context & context)
 {
   using namespace script;
 
-  Script s = mEngine.newScript(SourceFile{ activeProfileDir().absoluteFilePath("state.dex").toUtf8().data() });
+  Script s = context.engine()->newScript(SourceFile{ context.profileDirectory().absoluteFilePath("state.dex").toUtf8().data() });
   if (!s.compile())
   {
     qDebug() << "Could not load state file";
@@ -317,7 +405,7 @@ void Application::load_state()
     throw std::runtime_error{ "Could not load state file" };
   }
 
-  typedef void(*ClassActionCallback)(Application&, const script::Class&);
+  typedef void(*ClassActionCallback)(dex::Context&, const script::Class&);
   QMap<std::string, ClassActionCallback> actions;
   actions["State"] = register_state_type;
 
@@ -327,7 +415,7 @@ void Application::load_state()
     {
       auto action = actions.value(c.name(), nullptr);
       actions.remove(c.name());
-      action(*this, c);
+      action(context, c);
     }
   }
 
@@ -340,16 +428,145 @@ void Application::load_state()
   }
 }
 
+namespace
+{
+
+class ParserThread : public QThread
+{
+public:
+  ParserThread(dex::Context & context, const QStringList & files)
+    : mContext(context)
+    , mFiles(files)
+  {
+
+  }
+
+  json::Json result;
+  QString error;
+
+protected:
+  void run() override
+  {
+    try
+    {
+      mContext.documentProcessor()->setState(mContext.state());
+      mContext.documentProcessor()->processFiles(mFiles);
+      result = dex::serialization::serialize(mContext.state().get());
+    }
+    catch (std::runtime_error & ex)
+    {
+      error = ex.what();
+    }
+    catch (...)
+    {
+      error = "unknown error";
+    }
+  }
+
+private:
+  dex::Context & mContext;
+  QStringList mFiles;
+};
+
+} // namespace
+
 void Application::process(const QString & dirPath)
 {
-  mDocumentProcessor->setState(mState);
   QDir dir{ dirPath };
-  mDocumentProcessor->process(dir);
+  const QStringList files = mContext.documentProcessor()->listFiles(dir);
+  const int njobs = std::min(jobs(), files.size());
+
+  dex::DocumentProcessor::Statistics stats;
+
+  if (njobs <= 1)
+  {
+    mContext.documentProcessor()->setState(mContext.state());
+    mContext.documentProcessor()->processFiles(files);
+    stats = mContext.documentProcessor()->statistics();
+  }
+  else
+  {
+    stats = processInParallel(files, njobs);
+  }
+
+  qDebug() << "Processed" << stats.processedFiles << "files," << stats.skippedFiles << "skipped without any block,"
+    << stats.cachedFiles << "read from the cache";
+}
+
+/*!
+ * \fn dex::DocumentProcessor::Statistics Application::processInParallel(const QStringList & files, int jobs)
+ * \brief Parses the files with several contexts, one per thread.
+ *
+ * Each context parses a contiguous range of the files. The states of the
+ * workers are then serialized and merged, in the order of the files, into
+ * the state of the main context.
+ */
+dex::DocumentProcessor::Statistics Application::processInParallel(const QStringList & files, int jobs)
+{
+  std::vector<std::unique_ptr<dex::Context>> workers;
+
+  // The contexts are set up one after the other; loading the same profile
+  // in each engine is expected to produce the same type ids, which the
+  // serialized states rely on.
+  for (int i(0); i < jobs; ++i)
+  {
+    std::unique_ptr<dex::Context> w{ new dex::Context };
+    initContext(*w);
+    setupContext(*w);
+    workers.push_back(std::move(w));
+
+    if (workers.back()->state().get().type() != mContext.state().get().type())
+      throw std::runtime_error{ "Worker engines do not agree on the State type" };
+  }
+
+  std::vector<std::unique_ptr<ParserThread>> threads;
+
+  for (int i(0); i < jobs; ++i)
+  {
+    const int begin = files.size() * i / jobs;
+    const int end = files.size() * (i + 1) / jobs;
+    threads.push_back(std::unique_ptr<ParserThread>(new ParserThread{ *workers.at(i), files.mid(begin, end - begin) }));
+    threads.back()->start();
+  }
+
+  for (const auto & t : threads)
+    t->wait();
+
+  dex::DocumentProcessor::Statistics stats;
+  QString error;
+
+  for (size_t i(0); i < threads.size(); ++i)
+  {
+    if (!threads.at(i)->error.isEmpty())
+    {
+      qDebug() << "Worker" << i << "failed:" << threads.at(i)->error;
+      error = threads.at(i)->error;
+      continue;
+    }
+
+    if (error.isEmpty())
+    {
+      script::Value val = dex::serialization::deserialize(mContext.engine(), threads.at(i)->result, mContext.state().get().type());
+      dex::State partial{ val };
+      mContext.state().merge(partial);
+      partial.destroy();
+    }
+
+    const auto & s = workers.at(i)->documentProcessor()->statistics();
+    stats.processedFiles += s.processedFiles;
+    stats.skippedFiles += s.skippedFiles;
+    stats.cachedFiles += s.cachedFiles;
+  }
+
+  if (!error.isEmpty())
+    throw std::runtime_error{ error.toStdString() };
+
+  return stats;
 }
 
 void Application::output(const QString & dir)
 {
-  dex::Output::current()->write(dir);
+  mContext.output()->write(dir);
 }
 
 QDir Application::inputDirectory() const
@@ -405,25 +622,23 @@ QDir Application::activeProfileDir() const
   return d;
 }
 
-dex::DocumentProcessor* Application::documentProcessor()
+int Application::jobs() const
 {
-  return mDocumentProcessor.get();
+  return mCliOptions.jobs;
 }
 
-script::Engine* Application::scriptEngine()
+dex::Context & Application::context()
 {
-  return &DexInstance()->mEngine;
+  return mContext;
 }
 
-static void load_outputs_scripts_recur(Application & app, QList<script::Script> & scripts, const QDir & dir)
+static void load_outputs_scripts_recur(script::Engine *engine, QList<script::Script> & scripts, const QDir & dir)
 {
-  script::Engine *engine = app.scriptEngine();
-
   for (const auto & f : dir.entryInfoList(QDir::NoDotAndDotDot | QDir::Files | QDir::Dirs))
   {
     if (f.isDir())
     {
-      load_outputs_scripts_recur(app, scripts, QDir{ f.absoluteFilePath() });
+      load_outputs_scripts_recur(engine, scripts, QDir{ f.absoluteFilePath() });
       continue;
     }
 
@@ -472,24 +687,92 @@ static void load_outputs_scripts_recur(Application & app, QList<script::Script>
 //  return result;
 //}
 
-void Application::load_outputs()
+static QString output_name(const script::Class & c)
+{
+  return QString::fromStdString(c.name()).toLower();
+}
+
+static QStringList find_output_module(const QDir & outputDir, const QString & format)
+{
+  QDirIterator it{ outputDir.absolutePath(), QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories };
+
+  while (it.hasNext())
+  {
+    const QFileInfo info{ it.next() };
+
+    if (info.suffix() == "dex" && info.completeBaseName().toLower() == format)
+    {
+      const QString rel = outputDir.relativeFilePath(info.absoluteFilePath());
+      return rel.left(rel.size() - 4).split('/');
+    }
+  }
+
+  return QStringList{};
+}
+
+static bool load_output_module(script::Engine *engine, const QStringList & path)
 {
-  script::Module m = scriptEngine()->getModule("output");
+  script::Module m = engine->getModule("output");
+
+  for (const auto & name : path)
+  {
+    if (m.isNull())
+      return false;
+    m = m.getSubModule(name.toStdString());
+  }
+
+  if (m.isNull())
+    return false;
 
   m.load();
+  return true;
+}
+
+// constructs the Output class named after the format, if one has been compiled
+static bool construct_output(dex::Context & context, const QString & format)
+{
+  script::Engine *engine = context.engine();
 
-  for (const script::Script& s : scriptEngine()->scripts())
+  for (const script::Script& s : engine->scripts())
   {
     for (const script::Class& c : s.classes())
     {
-      if (c.inherits(scriptEngine()->typeSystem()->getClass(script::Type::DexOutput)))
+      if (c.inherits(engine->typeSystem()->getClass(script::Type::DexOutput)) && output_name(c) == format)
       {
-        script::Value impl = scriptEngine()->construct(c.id(), {});
-        mOutputs.push_back(std::unique_ptr<dex::Output>(new dex::Output(impl)));
+        script::Value impl = engine->construct(c.id(), {});
+        context.addOutput(std::unique_ptr<dex::Output>(new dex::Output(impl)));
+        return true;
       }
     }
   }
 
+  return false;
+}
+
+/*!
+ * \fn void Application::load_outputs(dex::Context & context)
+ * \brief Compiles and constructs the output selected by the command line or the settings.
+ *
+ * Only the module whose file is named after the output is compiled.
+ * The whole output module is compiled if there is no such file, or if
+ * it does not define the output.
+ */
+void Application::load_outputs(dex::Context & context)
+{
+  script::Engine *engine = context.engine();
+  const QString format = outputFormat();
+  const QDir output_dir{ context.profileDirectory().absoluteFilePath("output") };
+
+  const QStringList path = find_output_module(output_dir, format);
+  if (!path.isEmpty() && load_output_module(engine, path) && construct_output(context, format))
+    return;
+
+  script::Module m = engine->getModule("output");
+
+  m.load();
+
+  construct_output(context, format);
+
   //QList<script::Script> scripts;
   //QDir output = activeProfileDir();
   //output.cd("output");
@@ -499,6 +782,6 @@ void Application::load_outputs()
   //  throw std::runtime_error{ "Missing output directory in profile" };
   //}
 
-  //load_outputs_scripts_recur(*this, scripts, output);
+  //load_outputs_scripts_recur(engine, scripts, output);
   //mOutputs = ::load_outputs(scripts);
 }
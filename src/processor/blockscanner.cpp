@@ -0,0 +1,128 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/blockscanner.h"
+
+namespace dex
+{
+
+BlockScanner::BlockScanner()
+{
+
+}
+
+BlockScanner::BlockScanner(const QString & start, const QString & end)
+{
+  setDelimiters(start, end);
+}
+
+void BlockScanner::setDelimiters(const QString & start, const QString & end)
+{
+  mDelimiters.clear();
+  addDelimiters(start, end);
+}
+
+void BlockScanner::addDelimiters(const QString & start, const QString & end)
+{
+  Delimiters delims;
+  delims.start.setPattern(start);
+  delims.end.setPattern(end);
+  delims.utf8_start.setPattern(start.toUtf8());
+  mDelimiters.push_back(delims);
+}
+
+bool BlockScanner::mayContainBlock(const char *utf8, int size) const
+{
+  for (const auto & delims : mDelimiters)
+  {
+    if (delims.utf8_start.indexIn(utf8, size) != -1)
+      return true;
+  }
+
+  return false;
+}
+
+static int skip_indentation(const QString & document, int pos)
+{
+  while (pos < document.length() && document.at(pos) != '\n' && document.at(pos).isSpace())
+    ++pos;
+  return pos;
+}
+
+int BlockScanner::findEnd(const QString & document, const Delimiters & delims, int from) const
+{
+  if (!delims.isLineComment())
+  {
+    const int end = delims.end.indexIn(document, from);
+    // an unterminated block extends to the end of the document
+    return end == -1 ? document.length() : end;
+  }
+
+  const QString & marker = delims.start.pattern();
+
+  int eol = document.indexOf('\n', from);
+
+  while (eol != -1)
+  {
+    const int next = skip_indentation(document, eol + 1);
+
+    if (document.midRef(next, marker.length()) != marker)
+      return eol;
+
+    eol = document.indexOf('\n', next + marker.length());
+  }
+
+  return document.length();
+}
+
+QVector<BlockScanner::Block> BlockScanner::scan(const QString & document) const
+{
+  QVector<Block> result;
+
+  if (mDelimiters.size() == 1 && mDelimiters.front().start.pattern().isEmpty())
+  {
+    result.push_back(Block{ 0, document.length(), 0 });
+    return result;
+  }
+
+  // position of the next occurrence of each start delimiter
+  QVector<int> next(mDelimiters.size(), -1);
+  for (int i(0); i < mDelimiters.size(); ++i)
+  {
+    if (!mDelimiters.at(i).start.pattern().isEmpty())
+      next[i] = mDelimiters.at(i).start.indexIn(document, 0);
+  }
+
+  for (;;)
+  {
+    int selected = -1;
+
+    for (int i(0); i < next.size(); ++i)
+    {
+      if (next.at(i) != -1 && (selected == -1 || next.at(i) < next.at(selected)))
+        selected = i;
+    }
+
+    if (selected == -1)
+      break;
+
+    const Delimiters & delims = mDelimiters.at(selected);
+
+    Block b;
+    b.begin = next.at(selected) + delims.start.pattern().length();
+    b.end = findEnd(document, delims, b.begin);
+    b.delimiters = selected;
+    result.push_back(b);
+
+    for (int i(0); i < next.size(); ++i)
+    {
+      if (next.at(i) != -1 && next.at(i) < b.end)
+        next[i] = mDelimiters.at(i).start.indexIn(document, b.end);
+    }
+  }
+
+  return result;
+}
+
+} // namespace dex
@@ -80,6 +80,16 @@ json::Json BeginCommand::invoke(DocumentProcessor *processor, const Options& opt
 {
   auto env = get_environment(processor, arguments);
 
+  if (env->isRaw())
+  {
+    // the content is consumed up to the matching \end, which is never
+    // seen by the parser
+    QString content = processor->readRawEnvironment(env->name());
+    env->enterRaw(opts, content);
+    env->leave();
+    return nullptr;
+  }
+
   env->enter(opts);
   processor->enter(env);
 
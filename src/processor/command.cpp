@@ -16,8 +16,6 @@
 namespace dex
 {
 
-Command::TypeInfo Command::static_type_info = {};
-
 namespace callbacks
 {
 static script::Value command_dummy_callback(script::FunctionCall *c)
@@ -30,12 +28,10 @@ void Command::registerCommandType(script::Engine *e)
 {
   using namespace script;
 
-  Class command = e->rootNamespace().newClass("Command").get();
+  Class command = e->rootNamespace().newClass("Command").setId(Type::DexCommand).get();
 
   command.newConstructor(callbacks::command_dummy_callback).create();
   command.newDestructor(callbacks::command_dummy_callback).create();
-
-  dex::Command::type_info().type = command.id();
 }
 
 } // namespace dex
\ No newline at end of file
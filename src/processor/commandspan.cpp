@@ -27,12 +27,9 @@ static script::Value dummy(script::FunctionCall *c)
 namespace dex
 {
 
-CommandSpan::TypeInfo CommandSpan::static_type_info = CommandSpan::TypeInfo{};
-
-
 script::Type CommandSpan::getBaseType()
 {
-  return type_info().span_type;
+  return script::Type::DexSpan;
 }
 
 script::Type CommandSpan::getType(Value val)
@@ -40,11 +37,13 @@ script::Type CommandSpan::getType(Value val)
   switch (val)
   {
   case dex::CommandSpan::Word:
-    return type_info().word_type;
+    return script::Type::DexSpanWord;
   case dex::CommandSpan::Line:
-    return type_info().line_type;
+    return script::Type::DexSpanLine;
   case dex::CommandSpan::Paragraph:
-    return type_info().paragraph_type;
+    return script::Type::DexSpanParagraph;
+  case dex::CommandSpan::Raw:
+    return script::Type::DexSpanRaw;
   case dex::CommandSpan::NotApplicable:
   default:
     throw std::runtime_error{ "Invalid span value" };
@@ -55,22 +54,18 @@ void CommandSpan::register_span_types(script::Namespace ns)
 {
   using namespace script;
 
-  Class Span = ns.newClass("Span").get();
-  Class Word = Span.newNestedClass("Word").setBase(Span).get();;
-  Class Line = Span.newNestedClass("Line").setBase(Span).get();;
-  Class Paragraph = Span.newNestedClass("Paragraph").setBase(Span).get();;
+  Class Span = ns.newClass("Span").setId(Type::DexSpan).get();
+  Class Word = Span.newNestedClass("Word").setId(Type::DexSpanWord).setBase(Span).get();
+  Class Line = Span.newNestedClass("Line").setId(Type::DexSpanLine).setBase(Span).get();
+  Class Paragraph = Span.newNestedClass("Paragraph").setId(Type::DexSpanParagraph).setBase(Span).get();
+  Class Raw = Span.newNestedClass("Raw").setId(Type::DexSpanRaw).setBase(Span).get();
 
-  for (Class c : { Span, Word, Line, Paragraph })
+  for (Class c : { Span, Word, Line, Paragraph, Raw })
   {
     c.newConstructor(callbacks::dummy).create();
     c.newConstructor(callbacks::dummy).params(Type::cref(c.id())).create();
     c.newDestructor(callbacks::dummy).create();
   }
-
-  dex::CommandSpan::type_info().span_type = Span.id();
-  dex::CommandSpan::type_info().word_type = Word.id();
-  dex::CommandSpan::type_info().line_type = Line.id();
-  dex::CommandSpan::type_info().paragraph_type = Paragraph.id();
 }
 
 script::Value CommandSpan::expose(Value val, script::Engine *e)
@@ -0,0 +1,507 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/directorywalker.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QSharedPointer>
+#include <QTextStream>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace dex
+{
+
+static QString glob_to_regexp(const QString & glob)
+{
+  QString result;
+
+  for (int i(0); i < glob.size(); ++i)
+  {
+    const QChar c = glob.at(i);
+
+    if (c == '\\' && i + 1 < glob.size())
+    {
+      result += QRegularExpression::escape(QString(glob.at(i + 1)));
+      i += 1;
+    }
+    else if (c == '*')
+    {
+      if (i + 1 < glob.size() && glob.at(i + 1) == '*')
+      {
+        // "**/" matches any number of directories, a trailing "**" anything
+        if (i + 2 < glob.size() && glob.at(i + 2) == '/')
+        {
+          result += "(?:.*/)?";
+          i += 2;
+        }
+        else
+        {
+          result += ".*";
+          i += 1;
+        }
+      }
+      else
+      {
+        result += "[^/]*";
+      }
+    }
+    else if (c == '?')
+    {
+      result += "[^/]";
+    }
+    else if (c == '[' && glob.indexOf(']', i + 1) != -1)
+    {
+      const int end = glob.indexOf(']', i + 1);
+      QString set = glob.mid(i + 1, end - i - 1);
+      if (set.startsWith('!'))
+        set[0] = '^';
+      result += '[' + set.replace("\\", "\\\\") + ']';
+      i = end;
+    }
+    else
+    {
+      result += QRegularExpression::escape(QString(c));
+    }
+  }
+
+  return result;
+}
+
+/*!
+ * \fn bool DirectoryWalker::parsePattern(const QString & line, Pattern & result)
+ * \brief Parses a line of an ignore file, or a pattern given on the command line.
+ *
+ * As with git, trailing spaces are ignored unless escaped with a backslash,
+ * and a leading backslash makes '#' and '!' literal.
+ * Returns false for blank lines and comments.
+ */
+bool DirectoryWalker::parsePattern(const QString & line, Pattern & result)
+{
+  QString glob = line;
+
+  while (!glob.isEmpty() && glob.at(glob.size() - 1).isSpace() && !glob.endsWith("\\ "))
+    glob.chop(1);
+
+  if (glob.isEmpty() || glob.startsWith('#'))
+    return false;
+
+  result.negated = glob.startsWith('!');
+  if (result.negated)
+    glob.remove(0, 1);
+  else if (glob.startsWith("\\#") || glob.startsWith("\\!"))
+    glob.remove(0, 1);
+
+  result.directoryOnly = glob.endsWith('/');
+  if (result.directoryOnly)
+    glob.chop(1);
+
+  const bool anchored = glob.contains('/');
+  if (glob.startsWith('/'))
+    glob.remove(0, 1);
+
+  if (glob.isEmpty())
+    return false;
+
+  const QString prefix = anchored ? QString("^") : QString("^(?:.*/)?");
+  result.regexp = QRegularExpression(prefix + glob_to_regexp(glob) + "$");
+  result.regexp.optimize();
+
+  return true;
+}
+
+namespace
+{
+
+struct IgnoreFile
+{
+  QSharedPointer<const IgnoreFile> parent;
+  QString base; // directory of the file, relative to the root of the walk
+  QVector<DirectoryWalker::Pattern> patterns;
+};
+
+enum MatchResult
+{
+  NoMatch,
+  Matched,
+  Negated,
+};
+
+// as with git, later patterns take precedence
+MatchResult match(const QVector<DirectoryWalker::Pattern> & patterns, const QString & path, bool dir)
+{
+  for (int i(patterns.size() - 1); i >= 0; --i)
+  {
+    const DirectoryWalker::Pattern & p = patterns.at(i);
+
+    if (p.directoryOnly && !dir)
+      continue;
+
+    if (p.regexp.match(path).hasMatch())
+      return p.negated ? Negated : Matched;
+  }
+
+  return NoMatch;
+}
+
+bool matches(const QVector<DirectoryWalker::Pattern> & patterns, const QString & path, bool dir)
+{
+  return match(patterns, path, dir) == Matched;
+}
+
+bool is_ignored(const IgnoreFile *file, const QString & path, bool dir)
+{
+  // deeper files take precedence
+  for (; file != nullptr; file = file->parent.data())
+  {
+    const QString rel = file->base.isEmpty() ? path : path.mid(file->base.size() + 1);
+
+    const MatchResult r = match(file->patterns, rel, dir);
+    if (r != NoMatch)
+      return r == Matched;
+  }
+
+  return false;
+}
+
+QString join_path(const QString & dir, const QString & name)
+{
+  return dir.isEmpty() ? name : dir + '/' + name;
+}
+
+// orders paths component by component, ignoring the case as QDir does by
+// default, so that files come in the order of a depth-first walk of QDir listings
+bool path_less(const QString & a, const QString & b)
+{
+  const int n = std::min(a.size(), b.size());
+
+  for (int i(0); i < n; ++i)
+  {
+    const QChar x = a.at(i).toCaseFolded();
+    const QChar y = b.at(i).toCaseFolded();
+
+    if (x == y)
+      continue;
+
+    if (x == '/')
+      return true;
+    else if (y == '/')
+      return false;
+
+    return x < y;
+  }
+
+  if (a.size() != b.size())
+    return a.size() < b.size();
+
+  // paths that only differ by the case still need a deterministic order
+  return a < b;
+}
+
+struct Task
+{
+  QString path; // absolute path, possibly through symbolic links
+  QString relative;
+  QSharedPointer<const IgnoreFile> ignore;
+  QString canonical;
+};
+
+struct Entry
+{
+  QString relative;
+  QString path;
+};
+
+/*
+ * The state shared by the threads of a walk.
+ * All directories of a phase are real directories below a single top
+ * directory, so they cannot be duplicates of each other; directories
+ * reached through a symbolic link are deferred to later phases, which
+ * are run one at a time in the order of their paths.
+ */
+class Walk
+{
+public:
+  Walk(const DirectoryWalker & walker, const QVector<DirectoryWalker::Pattern> & includes, const QVector<DirectoryWalker::Pattern> & excludes)
+    : mWalker(walker)
+    , mIncludes(includes)
+    , mExcludes(excludes)
+    , mBusy(0)
+  {
+
+  }
+
+  void run(const Task & top);
+
+  bool visit(const QString & canonicalPath);
+
+  inline const QVector<Entry> & files() const { return mFiles; }
+
+protected:
+  void work();
+  void explore(const Task & t, QVector<Task> & subdirs, QVector<Task> & links, QVector<Entry> & files);
+
+private:
+  friend class WalkerThread;
+
+  const DirectoryWalker & mWalker;
+  const QVector<DirectoryWalker::Pattern> & mIncludes;
+  const QVector<DirectoryWalker::Pattern> & mExcludes;
+  QMutex mMutex;
+  QWaitCondition mCondition;
+  QVector<Task> mPending;
+  int mBusy;
+  QSet<QString> mVisited;
+  QVector<Task> mLinks;
+  QVector<Entry> mFiles;
+};
+
+class WalkerThread : public QThread
+{
+public:
+  explicit WalkerThread(Walk & w)
+    : mWalk(w)
+  {
+
+  }
+
+protected:
+  void run() override
+  {
+    mWalk.work();
+  }
+
+private:
+  Walk & mWalk;
+};
+
+bool Walk::visit(const QString & canonicalPath)
+{
+  QMutexLocker lock{ &mMutex };
+
+  if (mVisited.contains(canonicalPath))
+    return false;
+
+  mVisited.insert(canonicalPath);
+  return true;
+}
+
+void Walk::run(const Task & top)
+{
+  mPending.push_back(top);
+
+  while (!mPending.isEmpty())
+  {
+    std::vector<std::unique_ptr<WalkerThread>> threads;
+
+    for (int i(1); i < mWalker.workers(); ++i)
+    {
+      threads.push_back(std::unique_ptr<WalkerThread>(new WalkerThread{ *this }));
+      threads.back()->start();
+    }
+
+    work();
+
+    for (const auto & t : threads)
+      t->wait();
+
+    // next phase: the first of the remaining symbolic links
+    auto it = std::min_element(mLinks.begin(), mLinks.end(), [](const Task & a, const Task & b) {
+      return path_less(a.relative, b.relative);
+    });
+
+    while (it != mLinks.end())
+    {
+      Task link = *it;
+      mLinks.erase(it);
+
+      if (visit(link.canonical))
+      {
+        mPending.push_back(link);
+        break;
+      }
+
+      it = std::min_element(mLinks.begin(), mLinks.end(), [](const Task & a, const Task & b) {
+        return path_less(a.relative, b.relative);
+      });
+    }
+  }
+}
+
+void Walk::work()
+{
+  for (;;)
+  {
+    Task t;
+
+    {
+      QMutexLocker lock{ &mMutex };
+
+      while (mPending.isEmpty() && mBusy > 0)
+        mCondition.wait(&mMutex);
+
+      if (mPending.isEmpty())
+      {
+        mCondition.wakeAll();
+        return;
+      }
+
+      t = mPending.takeLast();
+      ++mBusy;
+    }
+
+    QVector<Task> subdirs;
+    QVector<Task> links;
+    QVector<Entry> files;
+    explore(t, subdirs, links, files);
+
+    {
+      QMutexLocker lock{ &mMutex };
+
+      for (const auto & d : subdirs)
+      {
+        if (mVisited.contains(d.canonical))
+          continue;
+        mVisited.insert(d.canonical);
+        mPending.push_back(d);
+      }
+
+      mLinks += links;
+      mFiles += files;
+      --mBusy;
+      mCondition.wakeAll();
+    }
+  }
+}
+
+void Walk::explore(const Task & t, QVector<Task> & subdirs, QVector<Task> & links, QVector<Entry> & files)
+{
+  QDir dir{ t.path };
+
+  QSharedPointer<const IgnoreFile> ignore = t.ignore;
+
+  for (const auto & name : mWalker.ignoreFiles())
+  {
+    QFile f{ dir.filePath(name) };
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+      continue;
+
+    auto rules = QSharedPointer<IgnoreFile>::create();
+    rules->parent = ignore;
+    rules->base = t.relative;
+
+    QTextStream stream{ &f };
+    while (!stream.atEnd())
+    {
+      DirectoryWalker::Pattern p;
+      if (DirectoryWalker::parsePattern(stream.readLine(), p))
+        rules->patterns.push_back(p);
+    }
+
+    if (!rules->patterns.isEmpty())
+      ignore = rules;
+  }
+
+  for (const auto & f : dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot))
+  {
+    const QString rel = join_path(t.relative, f.fileName());
+
+    if (f.isDir())
+    {
+      if (f.fileName() == ".git" || matches(mExcludes, rel, true) || is_ignored(ignore.data(), rel, true))
+        continue;
+
+      Task sub{ f.absoluteFilePath(), rel, ignore, f.canonicalFilePath() };
+
+      if (f.isSymLink())
+        links.push_back(sub);
+      else
+        subdirs.push_back(sub);
+    }
+    else
+    {
+      if (matches(mExcludes, rel, false) || is_ignored(ignore.data(), rel, false))
+        continue;
+
+      if (!mIncludes.isEmpty() && !matches(mIncludes, rel, false))
+        continue;
+
+      files.push_back(Entry{ rel, f.absoluteFilePath() });
+    }
+  }
+}
+
+} // namespace
+
+DirectoryWalker::DirectoryWalker()
+  : mWorkers(std::max(1, std::min(4, QThread::idealThreadCount())))
+{
+  mIgnoreFiles << ".gitignore" << ".dexignore";
+}
+
+void DirectoryWalker::addIncludePattern(const QString & pattern)
+{
+  Pattern p;
+  if (parsePattern(pattern, p))
+    mIncludes.push_back(p);
+}
+
+void DirectoryWalker::addExcludePattern(const QString & pattern)
+{
+  Pattern p;
+  if (parsePattern(pattern, p))
+    mExcludes.push_back(p);
+}
+
+void DirectoryWalker::addExtension(const QString & ext)
+{
+  QString e = ext.trimmed();
+  if (e.startsWith('.'))
+    e.remove(0, 1);
+
+  if (!e.isEmpty())
+    addIncludePattern("*." + e);
+}
+
+void DirectoryWalker::setIgnoreFiles(const QStringList & names)
+{
+  mIgnoreFiles = names;
+}
+
+void DirectoryWalker::setWorkers(int n)
+{
+  mWorkers = std::max(1, n);
+}
+
+/*!
+ * \fn QStringList DirectoryWalker::list(const QDir & root) const
+ * \brief Returns the absolute paths of the files to process below \a root.
+ */
+QStringList DirectoryWalker::list(const QDir & root) const
+{
+  Walk w{ *this, mIncludes, mExcludes };
+  w.visit(root.canonicalPath());
+  w.run(Task{ root.absolutePath(), QString(), QSharedPointer<const IgnoreFile>(), root.canonicalPath() });
+
+  QVector<Entry> entries = w.files();
+  std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) {
+    return path_less(a.relative, b.relative);
+  });
+
+  QStringList result;
+  result.reserve(entries.size());
+  for (const auto & e : entries)
+    result.append(e.path);
+  return result;
+}
+
+} // namespace dex
@@ -4,11 +4,16 @@
 
 #include "dex/processor/documentprocessor.h"
 
+#include "dex/context.h"
 #include "dex/core/options.h"
 #include "dex/core/output.h"
+#include "dex/core/serialization.h"
 #include "dex/processor/builtincommand.h"
 #include "dex/processor/command.h"
 #include "dex/processor/environment.h"
+#include "dex/processor/filecache.h"
+#include "dex/processor/inputfile.h"
+#include "dex/processor/prefetcher.h"
 #include "dex/processor/rootenvironment.h"
 
 #include <script/engine.h>
@@ -16,7 +21,7 @@
 #include <script/script.h>
 
 #include <QDebug>
-#include <QFile>
+#include <QFileInfo>
 
 namespace dex
 {
@@ -26,6 +31,7 @@ InputStream::InputStream(const QString & doc)
   Document document;
   document.content = doc;
   document.pos = 0;
+  document.end = doc.length();
   mDocuments.push(document);
 }
 
@@ -34,12 +40,14 @@ void InputStream::inject(const QString & content)
   Document d;
   d.content = content;
   d.pos = 0;
+  d.end = content.length();
   mDocuments.push(d);
 }
 
 QChar InputStream::peekChar() const
 {
-  return currentDocument().content[currentPos()];
+  const Document & doc = currentDocument();
+  return doc.pos < doc.end ? doc.content.at(doc.pos) : QChar();
 }
 
 QChar InputStream::readChar()
@@ -57,13 +65,16 @@ QChar InputStream::readChar()
 QStringRef InputStream::peek(int n) const
 {
   auto & doc = currentDocument();
-  return doc.content.midRef(doc.pos, n);
+  return doc.content.midRef(doc.pos, std::min(n, doc.end - doc.pos));
 }
 
 QStringRef InputStream::peekLine() const
 {
-  int n = std::max(currentDocument().content.indexOf('\n', currentPos()), currentDocument().length());
-  return peek(n - currentPos());
+  auto & doc = currentDocument();
+  int n = doc.content.indexOf('\n', doc.pos);
+  if (n == -1 || n > doc.end)
+    n = doc.end;
+  return doc.content.midRef(doc.pos, n - doc.pos);
 }
 
 bool InputStream::read(const QString & text)
@@ -79,7 +90,30 @@ bool InputStream::read(const QString & text)
 void InputStream::discard(int n)
 {
   while (n > 0)
-    readChar(), --n;
+  {
+    Document & doc = currentDocument();
+    const int count = std::min(n, doc.length() - doc.pos);
+    doc.pos += count;
+    n -= count;
+
+    if (doc.pos == doc.length() && stackSize() > 1)
+      mDocuments.pop();
+    else
+      break;
+  }
+}
+
+void InputStream::seek(int pos)
+{
+  while (mDocuments.size() > 1)
+    mDocuments.pop();
+
+  currentDocument().pos = pos;
+}
+
+void InputStream::setBoundary(int pos)
+{
+  mDocuments.first().end = pos;
 }
 
 InputStream::Document & InputStream::currentDocument()
@@ -99,7 +133,7 @@ int InputStream::currentPos() const
 
 bool InputStream::atEnd() const
 {
-  return mDocuments.size() == 1 && currentDocument().pos == currentDocument().content.length();
+  return mDocuments.size() == 1 && currentDocument().pos >= currentDocument().end;
 }
 
 InputStream & InputStream::operator=(const QString & str)
@@ -109,64 +143,177 @@ InputStream & InputStream::operator=(const QString & str)
   Document document;
   document.content = str;
   document.pos = 0;
+  document.end = str.length();
   mDocuments.push(document);
 
   return *this;
 }
 
 
+namespace
+{
+
+enum {
+  W = StreamTokenizer::WordCharacter,
+  S = StreamTokenizer::SpaceCharacter,
+  L = StreamTokenizer::EndOfLineCharacter,
+  B = StreamTokenizer::BeginGroupCharacter,
+  E = StreamTokenizer::EndGroupCharacter,
+  P = StreamTokenizer::PunctuatorCharacter,
+};
+
+const unsigned char ascii_character_classes[128] = {
+  W, W, W, W, W, W, W, W, W, S, L, S, S, S, W, W, // 0x00 - 0x0F
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, // 0x10 - 0x1F
+  S, W, P, W, W, W, W, P, W, W, W, W, P, W, P, W, //  !"#$%&'()*+,-./
+  W, W, W, W, W, W, W, W, W, W, W, P, W, P, W, W, // 0123456789:;<=>?
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, // @ABCDEFGHIJKLMNO
+  W, W, W, W, W, W, W, W, W, W, W, P, W, P, W, W, // PQRSTUVWXYZ[\]^_
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, // `abcdefghijklmno
+  W, W, W, W, W, W, W, W, W, W, W, B, W, E, W, W, // pqrstuvwxyz{|}~
+};
+
+} // namespace
+
 StreamTokenizer::StreamTokenizer(InputStream & is)
   : mStream(&is)
   , EscapeCharacter(QChar('\\'))
+  , mLookahead(nullptr)
+  , mLookaheadIndex(0)
 {
-  mPunctuators << '{' << '[' << '}' << ']' << '=' << ',' << '.' << ';' << '\'' << '"';
+
 }
 
-StreamTokenizer::Token StreamTokenizer::read()
+StreamTokenizer::CharacterClass StreamTokenizer::characterClass(QChar c)
+{
+  if (c.unicode() < 128)
+    return static_cast<CharacterClass>(ascii_character_classes[c.unicode()]);
+
+  return c.isSpace() ? SpaceCharacter : WordCharacter;
+}
+
+/*!
+ * \fn StreamTokenizer::Token::Kind StreamTokenizer::lex(const QChar *data, int begin, int end, QChar escape, int *length)
+ * \brief Returns the kind of the token starting at \a begin and stores its length in \a length.
+ *
+ * This function does not depend on the state of any tokenizer and may be
+ * called from any thread.
+ */
+StreamTokenizer::Token::Kind StreamTokenizer::lex(const QChar *data, int begin, int end, QChar escape, int *length)
 {
-  mBuffer.clear();
-  
-  if (readSpaces())
-    return produce(Token::Space);
+  *length = 1;
+
+  if (begin >= end)
+  {
+    *length = 0;
+    return Token::Word;
+  }
+
+  const QChar c = data[begin];
+  const CharacterClass cc = characterClass(c);
+
+  if (cc == SpaceCharacter)
+  {
+    int pos = begin + 1;
+    while (pos < end && characterClass(data[pos]) == SpaceCharacter)
+      ++pos;
+    *length = pos - begin;
+    return Token::Space;
+  }
+
+  if (c == escape)
+    return Token::EscapeCharacter;
 
-  if (stream().peekChar() == EscapeCharacter)
-    return readChar(), produce(Token::EscapeCharacter);
-  else if (stream().peekChar() == '\n')
-    return readChar(), produce(Token::EndOfLine);
-  else if (stream().peekChar() == '{')
-    return readChar(), produce(Token::BeginGroup);
-  else if (stream().peekChar() == '}')
-    return readChar(), produce(Token::EndGroup);
-  else if (mPunctuators.contains(stream().peekChar()))
-    return readChar(), produce(Token::Other);
+  switch (cc)
+  {
+  case EndOfLineCharacter:
+    return Token::EndOfLine;
+  case BeginGroupCharacter:
+    return Token::BeginGroup;
+  case EndGroupCharacter:
+    return Token::EndGroup;
+  case PunctuatorCharacter:
+    return Token::Other;
+  default:
+    break;
+  }
 
-  while (!stream().atEnd() && !isPunctuatorOrSpace(stream().peekChar()))
-    readChar();
+  int pos = begin + 1;
+  while (pos < end && characterClass(data[pos]) == WordCharacter)
+    ++pos;
 
-  return produce(Token::Word);
+  *length = pos - begin;
+  return Token::Word;
 }
 
-void StreamTokenizer::readChar()
+/*!
+ * \fn void StreamTokenizer::tokenize(const QString & text, int begin, int end, QChar escape, QVector<Lexeme> & result)
+ * \brief Appends to \a result the tokens of the range [begin, end) of \a text.
+ */
+void StreamTokenizer::tokenize(const QString & text, int begin, int end, QChar escape, QVector<Lexeme> & result)
 {
-  mBuffer.append(stream().readChar());
+  const QChar *data = text.constData();
+
+  int pos = begin;
+
+  while (pos < end)
+  {
+    Lexeme l;
+    l.offset = pos;
+    l.kind = lex(data, pos, end, escape, &l.length);
+    result.push_back(l);
+    pos += l.length;
+  }
 }
 
-bool StreamTokenizer::isPunctuatorOrSpace(const QChar & c) const
+/*!
+ * \fn void StreamTokenizer::setLookahead(const QVector<Lexeme> *lexemes)
+ * \brief Provides the tokens of the bottom document of the stream, computed ahead of time.
+ *
+ * A token of \a lexemes is returned by read() only if it starts exactly at
+ * the current position of the stream; in any other case (inside an
+ * injected document, or after the parser consumed characters without the
+ * tokenizer) the token is computed on the spot. The result of read() is
+ * therefore the same with or without lookahead.
+ */
+void StreamTokenizer::setLookahead(const QVector<Lexeme> *lexemes)
 {
-  return c.isSpace() || mPunctuators.contains(c);
+  mLookahead = lexemes;
+  mLookaheadIndex = 0;
 }
 
-bool StreamTokenizer::readSpaces()
+StreamTokenizer::Token StreamTokenizer::read()
 {
-  while (stream().peekChar().isSpace() && stream().peekChar() != '\n')
-    readChar();
+  const InputStream::Document & doc = stream().currentDocument();
+
+  if (mLookahead != nullptr && stream().stackSize() == 1)
+  {
+    while (mLookaheadIndex < mLookahead->size() && mLookahead->at(mLookaheadIndex).offset < doc.pos)
+      ++mLookaheadIndex;
+
+    if (mLookaheadIndex < mLookahead->size())
+    {
+      const Lexeme & l = mLookahead->at(mLookaheadIndex);
 
-  return mBuffer.size() > 0;
+      if (l.offset == doc.pos && l.offset + l.length <= doc.end)
+      {
+        ++mLookaheadIndex;
+        return produce(l.kind, l.length);
+      }
+    }
+  }
+
+  int length = 0;
+  const Token::Kind k = lex(doc.content.constData(), doc.pos, doc.end, EscapeCharacter, &length);
+  return produce(k, length);
 }
 
-StreamTokenizer::Token StreamTokenizer::produce(Token::Kind k)
+StreamTokenizer::Token StreamTokenizer::produce(Token::Kind k, int length)
 {
-  return Token{ k, mBuffer };
+  const InputStream::Document & doc = stream().currentDocument();
+  Token tok{ k, doc.content, doc.pos, length };
+  stream().discard(length);
+  return tok;
 }
 
 
@@ -175,13 +322,21 @@ DocumentProcessor::DocumentProcessor()
   , mTokenizer(mInputStream)
 {
   auto root = QSharedPointer<dex::RootEnvironment>::create();
-  root->commands.append(QSharedPointer<dex::BeginCommand>::create());
-  root->commands.append(QSharedPointer<dex::EndCommand>::create());
-  root->commands.append(QSharedPointer<dex::InputCommand>::create());
+  root->addCommand(QSharedPointer<dex::BeginCommand>::create());
+  root->addCommand(QSharedPointer<dex::EndCommand>::create());
+  root->addCommand(QSharedPointer<dex::InputCommand>::create());
 
   mEnvironments.push(root);
-
-  mBlockDelimiter = QPair<QString, QString>("/*!!", "*/");
+  mLookupTableValid = false;
+
+  mBlockScanner.setDelimiters("/*!!", "*/");
+  mCurrentScanner = &mBlockScanner;
+  mCurrentBlock = -1;
+  mTextCoalescing = false;
+  mTokenizeAhead = true;
+  mCache = nullptr;
+  mReadAheadFiles = 8;
+  mReadAheadMemory = 32 * 1024 * 1024;
   //mIgnoredSequences << "* " << "*" << " * " << " *";
 }
 
@@ -197,64 +352,125 @@ QSharedPointer<Environment> DocumentProcessor::root() const
 
 void DocumentProcessor::process(const QDir & directory)
 {
-  for (const auto & f : directory.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot))
+  processFiles(listFiles(directory));
+}
+
+/*!
+ * \fn QStringList DocumentProcessor::listFiles(const QDir & directory) const
+ * \brief Returns the files of a directory in the order in which process() reads them.
+ *
+ * Files are selected by the directoryWalker().
+ */
+QStringList DocumentProcessor::listFiles(const QDir & directory) const
+{
+  return mDirectoryWalker.list(directory);
+}
+
+/*!
+ * \fn void DocumentProcessor::processFiles(const QStringList & files)
+ * \brief Processes a list of files, in order.
+ *
+ * Unless the read-ahead window is empty, the files are read and scanned
+ * (and tokenized, if tokenizeAhead() is true and no cache is set) by a
+ * Prefetcher thread while the scripts run on the calling thread. The Prefetcher works on a
+ * copy of the block delimiters taken when it starts; changes made by the
+ * scripts in the meantime apply to the next call.
+ */
+void DocumentProcessor::processFiles(const QStringList & files)
+{
+  if (mReadAheadFiles <= 0 || files.size() < 2)
   {
-    if (f.isDir())
+    for (const auto & path : files)
     {
-      process(QDir{ f.absoluteFilePath() });
-    }
-    else
-    {
-      mCurrentDir = directory;
-      processFile(f.absoluteFilePath());
+      mCurrentDir = QFileInfo{ path }.dir();
+      processFile(path);
     }
+
+    return;
   }
-}
 
-QSharedPointer<Environment> DocumentProcessor::getEnvironment(const QString & name) const
-{
-  for (int i(mEnvironments.size() - 1); i >= 0; --i)
+  Prefetcher prefetcher{ *this, files, mReadAheadFiles, mReadAheadMemory };
+  prefetcher.start();
+
+  for (int i(0); i < files.size(); ++i)
   {
-    auto env = mEnvironments.at(i);
-    auto result = env->getEnvironment(name);
-    if (result != nullptr)
-      return result;
+    PreparedFile file = prefetcher.take();
+    mCurrentDir = QFileInfo{ file.path }.dir();
+    processFile(file);
   }
 
-  return nullptr;
+  prefetcher.wait();
+
+  // the scanners of the prepared files belong to the prefetcher
+  mCurrentScanner = &mBlockScanner;
+}
+
+QSharedPointer<Environment> DocumentProcessor::getEnvironment(const QString & name) const
+{
+  updateLookupTable();
+  return mEnvironmentTable.value(name);
 }
 
 void DocumentProcessor::enter(const QSharedPointer<Environment> & env)
 {
   mEnvironments.push(env);
+  mLookupTableValid = false;
 }
 
 void DocumentProcessor::leave()
 {
   mEnvironments.pop();
+  mLookupTableValid = false;
+}
+
+void DocumentProcessor::updateLookupTable() const
+{
+  if (mLookupTableValid)
+    return;
+
+  mCommandTable.clear();
+  mEnvironmentTable.clear();
+
+  // environments higher in the stack shadow the ones below them
+  for (const auto & env : mEnvironments)
+  {
+    for (const auto & com : env->commands())
+    {
+      const QString name = com->name();
+      if (env->getCommand(name) == com)
+        mCommandTable.insert(name, com);
+    }
+
+    for (const auto & e : env->environments())
+    {
+      const QString name = e->name();
+      if (env->getEnvironment(name) == e)
+        mEnvironmentTable.insert(name, e);
+    }
+  }
+
+  mLookupTableValid = true;
 }
 
 
 void DocumentProcessor::input(const QString & filename)
 {
+  mInputs.append(mCurrentDir.absoluteFilePath(filename));
+
   if (!mCurrentDir.exists(filename))
   {
     qDebug() << "Could not find input file " << filename;
     return;
   }
 
-  QString path = mCurrentDir.filePath(filename);
-  QFile f{ path };
-  if (!f.open(QIODevice::ReadOnly))
+  InputFile f{ mCurrentDir.filePath(filename) };
+  if (!f.open())
   {
     qDebug() << "Could not open input file " << filename;
     return;
   }
 
-  QString content = QString::fromUtf8(f.readAll());
-  f.close();
-
-  mInputStream.inject(content);
+  mInputStream.inject(f.decode());
 }
 
 extern void register_eol_type(script::Namespace& ns); // defined in eol.cpp
@@ -272,7 +488,41 @@ void DocumentProcessor::registerApi(script::Engine *e)
 
 void DocumentProcessor::setBlockDelimiters(const QString & start, const QString & end)
 {
-  mBlockDelimiter = QPair<QString, QString>(start, end);
+  mBlockScanner.setDelimiters(start, end);
+}
+
+void DocumentProcessor::addBlockDelimiters(const QString & patterns, const QString & start, const QString & end)
+{
+  for (auto & ft : mFileTypes)
+  {
+    if (ft.patterns == patterns)
+    {
+      ft.scanner.addDelimiters(start, end);
+      return;
+    }
+  }
+
+  FileType ft;
+  ft.patterns = patterns;
+  for (const auto & p : QDir::nameFiltersFromString(patterns))
+    ft.globs.append(QRegExp(p, Qt::CaseSensitive, QRegExp::Wildcard));
+  ft.scanner.addDelimiters(start, end);
+
+  mFileTypes.append(ft);
+}
+
+const BlockScanner & DocumentProcessor::blockScanner(const QString & filename) const
+{
+  for (const auto & ft : mFileTypes)
+  {
+    for (const auto & glob : ft.globs)
+    {
+      if (glob.exactMatch(filename))
+        return ft.scanner;
+    }
+  }
+
+  return mBlockScanner;
 }
 
 void DocumentProcessor::addIgnoredSequence(const QString & val)
@@ -280,9 +530,47 @@ void DocumentProcessor::addIgnoredSequence(const QString & val)
   mIgnoredSequences << val;
 }
 
+void DocumentProcessor::setTextCoalescing(bool on)
+{
+  mTextCoalescing = on;
+}
+
+/*!
+ * \fn void DocumentProcessor::setCache(FileCache *cache)
+ * \brief Sets the cache used to skip files that did not change since the previous run.
+ *
+ * When a cache is set, the List data members of the State are emptied
+ * before each file is parsed; what they hold afterwards is recorded as
+ * the contribution of the file, and replayed with State::merge() on the
+ * next runs. Files therefore do not see the lists filled by the previous
+ * files, as with several jobs.
+ * The DocumentProcessor does not take ownership of the cache.
+ */
+void DocumentProcessor::setCache(FileCache *cache)
+{
+  mCache = cache;
+}
+
+void DocumentProcessor::setTokenizeAhead(bool on)
+{
+  mTokenizeAhead = on;
+}
+
+/*!
+ * \fn void DocumentProcessor::setReadAhead(int files, qint64 memory)
+ * \brief Sets the number of files, and the number of bytes, that may be prepared ahead of the parser.
+ *
+ * A window of 0 files disables read-ahead.
+ */
+void DocumentProcessor::setReadAhead(int files, qint64 memory)
+{
+  mReadAheadFiles = files;
+  mReadAheadMemory = memory;
+}
+
 bool DocumentProcessor::isSpace(const json::Json& data)
 {
-  return data.isObject() && data["__type"] == script::Type::DexEOL;
+  return data.isObject() && data["__type"] == script::Type::DexSpace;
 }
 
 bool DocumentProcessor::isEOL(const json::Json& data)
@@ -292,64 +580,56 @@ bool DocumentProcessor::isEOL(const json::Json& data)
 
 json::Json DocumentProcessor::createSpace(const QString& str)
 {
-  json::Json result;
-  result["content"] = str;
-  result["__type"] = script::Type::DexSpace;
-  return result;
+  return Node::createSpace(str);
 }
 
 json::Json DocumentProcessor::createEOL()
 {
-  json::Json result;
-  result["__type"] = script::Type::DexEOL;
-  return result;
+  return Node::createEOL();
 }
 
 QString DocumentProcessor::stringify(const json::Json& data)
 {
-  return dex::Output::current()->stringify(data);
+  return dex::Context::get(engine())->output()->stringify(data);
 }
 
-json::Json DocumentProcessor::read()
+Node DocumentProcessor::read()
 {
   auto token = mTokenizer.read();
 
   if (token.kind == StreamTokenizer::Token::EscapeCharacter)
-    return readCommand(mTokenizer.read());
+    return Node::fromJson(readCommand(mTokenizer.read()));
 
   return createNode(token);
 }
 
-json::Json DocumentProcessor::readArgument()
+Node DocumentProcessor::readArgument()
 {
   auto token = mTokenizer.read();
   if (token.kind == StreamTokenizer::Token::Space) /// TODO: should we consider EOL too ?
     token = mTokenizer.read();
 
   if (token.kind == StreamTokenizer::Token::EscapeCharacter)
-    return readCommand(mTokenizer.read());
+    return Node::fromJson(readCommand(mTokenizer.read()));
 
   return createNode(token);
 }
 
 json::Json DocumentProcessor::readLineArgument()
 {
-  json::Json arg = readArgument();
+  Node arg = readArgument();
 
   json::Array group;
 
-  while (!isEOL(arg))
+  while (!arg.isEOL())
   {
-    group.push(arg);
+    group.push(mWords.toJson(arg));
     if (atBlockEnd())
       break;
     arg = read();
   }
 
-  if (group.length() == 0 && (isSpace(group.data().back()) || isEOL(group.data().back())))
-  {
-    /// TODO : remove last element from group
-  }
+  /// TODO : remove trailing space from group
 
   if (group.length() == 1)
     return group.at(0);
@@ -365,11 +645,11 @@ json::Json DocumentProcessor::readParagraphArgument()
 
   while (!atBlockEnd())
   {
-    json::Json node = read();
-    if (isEOL(node) && eol)
+    Node node = read();
+    if (node.isEOL() && eol)
       break;
-    eol = isEOL(node);
-    group.push(node);
+    eol = node.isEOL();
+    group.push(mWords.toJson(node));
   }
 
   /// TODO : remove space of eol at end and beginning of group.
@@ -377,16 +657,65 @@ json::Json DocumentProcessor::readParagraphArgument()
   return group;
 }
 
-json::Json DocumentProcessor::createNode(const StreamTokenizer::Token & tok)
+QString DocumentProcessor::readRawArgument()
+{
+  while (mInputStream.peekChar() != '\n' && mInputStream.peekChar().isSpace())
+    mInputStream.readChar();
+
+  QStringRef line = mInputStream.peekLine();
+  QString result = line.toString();
+  mInputStream.discard(line.size());
+  return result;
+}
+
+/*!
+ * \fn QString DocumentProcessor::readRawEnvironment(const QString & name)
+ * \brief Reads the content of a raw environment without tokenizing it.
+ *
+ * The content extends up to the next '\end{name}' or to the end of the
+ * block. Line prefixes (comment markers and ignored sequences) are removed.
+ */
+QString DocumentProcessor::readRawEnvironment(const QString & name)
+{
+  const QString terminator = QString(mTokenizer.EscapeCharacter) + "end{" + name + "}";
+
+  QString result;
+
+  while (!atBlockEnd())
+  {
+    QStringRef line = mInputStream.peekLine();
+
+    const int index = line.indexOf(terminator);
+    if (index != -1)
+    {
+      result += line.left(index);
+      mInputStream.discard(index + terminator.length());
+      break;
+    }
+
+    result += line;
+    mInputStream.discard(line.size());
+
+    if (mInputStream.peekChar() == '\n')
+    {
+      result += mInputStream.readChar();
+      beginLine();
+    }
+  }
+
+  return result;
+}
+
+Node DocumentProcessor::createNode(const StreamTokenizer::Token & tok)
 {
   if (tok.kind == StreamTokenizer::Token::BeginGroup)
-    return readGroup(tok);
+    return Node{ Node::Group, readGroup(tok) };
   else if (tok.kind == StreamTokenizer::Token::Space)
-    return createSpace(tok.text);
+    return Node{ Node::Space, tok.source, tok.offset, tok.length };
   else if (tok.kind == StreamTokenizer::Token::EndOfLine)
-    return beginLine(), createEOL();
+    return beginLine(), Node{ Node::EOL, tok.source, tok.offset, tok.length };
   else
-    return tok.text;
+    return Node{ Node::Word, tok.source, tok.offset, tok.length };
 }
 
 json::Json DocumentProcessor::readGroup(const StreamTokenizer::Token & tok)
@@ -395,11 +724,11 @@ json::Json DocumentProcessor::readGroup(const StreamTokenizer::Token & tok)
 
   json::Array result;
 
-  while (mInputStream.nextChar() != '}')
+  while (mInputStream.nextChar() != '}' && !mInputStream.atEnd())
   {
-    auto element = read();
+    Node element = read();
     if (!element.isNull())
-      result.push(element);
+      result.push(mWords.toJson(element));
   }
 
   mTokenizer.read(); /// TODO: assert its a Token::EndGroup
@@ -421,7 +750,9 @@ Options DocumentProcessor::readOptions()
   StreamTokenizer::Token tok = mTokenizer.read();
   for (;;)
   {
-    if (tok.text == "," || tok.text == "]")
+    const bool closed = tok.text() == "]" || (tok.isEmpty() && mInputStream.atEnd());
+
+    if (tok.text() == "," || closed)
     {
       if (!argument.first.isEmpty())
       {
@@ -435,19 +766,19 @@ Options DocumentProcessor::readOptions()
       argument.second.clear();
       equal_sign_read = false;
 
-      if (tok.text == "]")
+      if (closed)
         break;
     }
-    else if (tok.text == "=")
+    else if (tok.text() == "=")
     {
       equal_sign_read = true;
     }
     else
     {
       if (equal_sign_read)
-        argument.second = tok.text;
+        argument.second = tok.toString();
       else
-        argument.first = tok.text;
+        argument.first = tok.toString();
     }
 
     tok = mTokenizer.read();
@@ -479,23 +810,16 @@ json::Json DocumentProcessor::parseOptions(const QString& val)
 
 QSharedPointer<Command> DocumentProcessor::findCommand(const QString & name) const
 {
-  for (int i(mEnvironments.size() - 1); i >= 0; --i)
-  {
-    auto env = mEnvironments.at(i);
-    auto com = env->getCommand(name);
-    if (com != nullptr)
-      return com;
-  }
-
-  return nullptr;
+  updateLookupTable();
+  return mCommandTable.value(name);
 }
 
 json::Json DocumentProcessor::readCommand(const StreamTokenizer::Token & token)
 {
-  auto command = findCommand(token.text);
+  auto command = findCommand(token.toString());
   if (command == nullptr)
   {
-    qDebug() << "No such command " << token.text;
+    qDebug() << "No such command " << token.text();
     throw std::runtime_error{ "No such command" };
   }
 
@@ -506,7 +830,7 @@ json::Json DocumentProcessor::readCommand(const StreamTokenizer::Token & token)
   {
     for (int i(0); i < argc; ++i)
     {
-      json::Json arg = readArgument();
+      json::Json arg = mWords.toJson(readArgument());
       arguments.append(arg);
     }
   }
@@ -514,7 +838,7 @@ json::Json DocumentProcessor::readCommand(const StreamTokenizer::Token & token)
   {
     if (command->span() == CommandSpan::Word || command->span() == CommandSpan::NotApplicable)
     {
-      json::Json arg = readArgument();
+      json::Json arg = mWords.toJson(readArgument());
       arguments.append(arg);
     }
     else if (command->span() == CommandSpan::Line)
@@ -527,6 +851,10 @@ json::Json DocumentProcessor::readCommand(const StreamTokenizer::Token & token)
       json::Json arg = readParagraphArgument();
       arguments.append(arg);
     }
+    else if (command->span() == CommandSpan::Raw)
+    {
+      arguments.append(readRawArgument());
+    }
   }
 
   if (!opts.data().empty() && !command->acceptsOptions())
@@ -534,21 +862,244 @@ json::Json DocumentProcessor::readCommand(const StreamTokenizer::Token & token)
     qDebug() << command->name() << "does not support bracket arguments";
   }
 
+  // the command may act on the state, which must first have received
+  // all the nodes that precede it
+  flushPendingNodes();
+
   return command->invoke(this, opts, arguments);
 }
 
+static const int max_batch_size = 256;
+
+void DocumentProcessor::dispatch(const Node & node)
+{
+  if (mTextCoalescing && (node.isWord() || node.isSpace()))
+  {
+    if (!mTextRun.extend(node))
+    {
+      flushTextRun();
+      mTextRun = node;
+    }
+
+    return;
+  }
+
+  flushTextRun();
+  deliver(node);
+}
+
+void DocumentProcessor::deliver(const Node & node)
+{
+  if (!mState->accepts(node.kind()))
+    return;
+
+  if (!mState->acceptsBatches())
+  {
+    mState->dispatch(mWords.toJson(node));
+    return;
+  }
+
+  mPendingNodes.push(mWords.toJson(node));
+
+  if (mPendingNodes.length() >= max_batch_size)
+    flushBatch();
+}
+
+void DocumentProcessor::flushTextRun()
+{
+  if (mTextRun.isNull())
+    return;
+
+  Node run = mTextRun;
+  mTextRun = Node{};
+  deliver(run);
+}
+
+void DocumentProcessor::flushBatch()
+{
+  if (mPendingNodes.length() == 0)
+    return;
+
+  // the script may keep a reference to the array, so it is not reused
+  json::Array nodes = mPendingNodes;
+  mPendingNodes = json::Array{};
+  mState->dispatchBatch(nodes);
+}
+
+void DocumentProcessor::flushPendingNodes()
+{
+  flushTextRun();
+  flushBatch();
+}
+
+
+/*!
+ * \fn DocumentProcessor::Scanners DocumentProcessor::scanners() const
+ * \brief Returns a copy of the block delimiters that shares no data with the processor.
+ *
+ * QRegExp is not thread-safe, even across implicitly shared copies, so
+ * the globs are rebuilt from their patterns.
+ */
+DocumentProcessor::Scanners DocumentProcessor::scanners() const
+{
+  Scanners result;
+  result.fallback = mBlockScanner;
+  result.escape = mTokenizer.EscapeCharacter;
+
+  for (const auto & ft : mFileTypes)
+  {
+    FileType copy;
+    copy.patterns = ft.patterns;
+    copy.scanner = ft.scanner;
+    for (const auto & glob : ft.globs)
+      copy.globs.append(QRegExp(glob.pattern(), glob.caseSensitivity(), glob.patternSyntax()));
+    result.fileTypes.append(copy);
+  }
+
+  return result;
+}
+
+const BlockScanner & DocumentProcessor::Scanners::get(const QString & filename) const
+{
+  for (const auto & ft : fileTypes)
+  {
+    for (const auto & glob : ft.globs)
+    {
+      if (glob.exactMatch(filename))
+        return ft.scanner;
+    }
+  }
+
+  return fallback;
+}
+
+static DocumentProcessor::PreparedFile prepare_file(const QString & path, bool tokenize, const BlockScanner & scanner, QChar escape)
+{
+  DocumentProcessor::PreparedFile result;
+  result.path = path;
+
+  InputFile f{ path };
+  if (!f.open())
+    return result;
+
+  result.opened = true;
+  result.scanner = &scanner;
+
+  // Files without any block are rejected on the raw bytes,
+  // before paying for the UTF-16 decoding and the script callbacks.
+  if (!result.scanner->mayContainBlock(f.data(), f.size()))
+  {
+    result.skipped = true;
+    return result;
+  }
+
+  result.content = f.decode();
+  result.blocks = result.scanner->scan(result.content);
+
+  if (tokenize)
+  {
+    for (const auto & b : result.blocks)
+      StreamTokenizer::tokenize(result.content, b.begin, b.end, escape, result.lexemes);
+  }
+
+  return result;
+}
+
+/*!
+ * \fn DocumentProcessor::PreparedFile DocumentProcessor::prepareFile(const QString & path, bool tokenize) const
+ * \brief Reads a file and locates its blocks, optionally tokenizing them.
+ */
+DocumentProcessor::PreparedFile DocumentProcessor::prepareFile(const QString & path, bool tokenize) const
+{
+  return prepare_file(path, tokenize, blockScanner(QFileInfo(path).fileName()), mTokenizer.EscapeCharacter);
+}
+
+/*!
+ * \fn DocumentProcessor::PreparedFile DocumentProcessor::prepareFile(const QString & path, bool tokenize, const Scanners & scanners)
+ * \brief Prepares a file with a copy of the block delimiters.
+ *
+ * This does not involve the processor nor the script engine and may be
+ * called from another thread. The scanner of the result points into
+ * \a scanners, which must outlive it.
+ */
+DocumentProcessor::PreparedFile DocumentProcessor::prepareFile(const QString & path, bool tokenize, const Scanners & scanners)
+{
+  return prepare_file(path, tokenize, scanners.get(QFileInfo(path).fileName()), scanners.escape);
+}
 
 void DocumentProcessor::processFile(const QString & path)
 {
+  processFile(prepareFile(path, false));
+}
+
+void DocumentProcessor::processFile(const PreparedFile & file)
+{
+  if (!file.opened)
+    return;
+
+  if (file.skipped)
   {
-    QFile f{ path };
-    if (!f.open(QIODevice::ReadOnly))
-      return;
-    mInputStream = QString::fromUtf8(f.readAll());
-    f.close();
+    mStatistics.skippedFiles += 1;
+    return;
+  }
+
+  mStatistics.processedFiles += 1;
+
+  if (mCache != nullptr)
+    processCachedFile(file);
+  else
+    parse(file);
+}
+
+void DocumentProcessor::processCachedFile(const PreparedFile & file)
+{
+  const QByteArray hash = FileCache::hash(file.content);
+  const script::Type state_type = mState->get().type();
+
+  json::Json contribution;
+
+  if (mCache->lookup(file.path, hash, contribution))
+  {
+    State partial{ serialization::deserialize(engine(), contribution, state_type) };
+    mState->merge(partial);
+    partial.destroy();
+    mStatistics.cachedFiles += 1;
+    return;
   }
 
-  mState->beginFile(path);
+  // Commands act on the state through the script variable, so the
+  // contribution of the file is recorded on the state itself.
+  QVector<QList<dex::Value>> previous = mState->detachLists();
+  mInputs.clear();
+
+  try
+  {
+    parse(file);
+  }
+  catch (...)
+  {
+    mState->reattachLists(previous);
+    throw;
+  }
+
+  QVector<FileCache::Dependency> inputs;
+  for (const auto & path : mInputs)
+    inputs.push_back(FileCache::Dependency{ path, FileCache::hashFile(path) });
+
+  mCache->store(file.path, hash, inputs, serialization::serialize(mState->get()));
+
+  mState->reattachLists(previous);
+}
+
+void DocumentProcessor::parse(const PreparedFile & file)
+{
+  mCurrentScanner = file.scanner;
+  mInputStream = file.content;
+  mTokenizer.setLookahead(file.lexemes.isEmpty() ? nullptr : &file.lexemes);
+  mBlocks = file.blocks;
+  mCurrentBlock = -1;
+
+  mState->beginFile(file.path);
 
   while (seekBlock())
   {
@@ -556,28 +1107,36 @@ void DocumentProcessor::processFile(const QString & path)
 
     while (!atBlockEnd())
     {
-      json::Json node = read();
+      Node node = read();
       if (!node.isNull())
-        mState->dispatch(node);
+        dispatch(node);
     }
 
+    flushPendingNodes();
     mState->endBlock();
   }
 
   mState->endFile();
+
+  mTokenizer.setLookahead(nullptr);
+  mWords.clear();
 }
 
 bool DocumentProcessor::seekBlock()
 {
-  while (!mInputStream.atEnd() && !mInputStream.read(mBlockDelimiter.first))
-    mInputStream.readChar();
+  if (++mCurrentBlock >= mBlocks.size())
+    return false;
+
+  const BlockScanner::Block & block = mBlocks.at(mCurrentBlock);
+  mInputStream.seek(block.begin);
+  mInputStream.setBoundary(block.end);
 
-  return !mInputStream.atEnd();
+  return true;
 }
 
 bool DocumentProcessor::atBlockEnd() const
 {
-  return mInputStream.peek(mBlockDelimiter.second.length()) == mBlockDelimiter.second;
+  return mInputStream.atEnd();
 }
 
 void DocumentProcessor::beginLine()
@@ -585,18 +1144,29 @@ void DocumentProcessor::beginLine()
   if (mInputStream.stackSize() > 1)
     return;
 
+  const auto & delims = mCurrentScanner->delimiters(mBlocks.at(mCurrentBlock).delimiters);
+
+  if (delims.isLineComment())
+  {
+    // Each line of a run of line comments starts with the delimiter
+    while (mInputStream.peekChar() != '\n' && mInputStream.peekChar().isSpace())
+      mInputStream.readChar();
+
+    mInputStream.read(delims.start.pattern());
+  }
+
   auto line = mInputStream.peekLine();
-  
-  int blockend = line.indexOf(mBlockDelimiter.second);
 
-  for (int i(0); i < blockend; ++i)
+  // If only spaces remain before the end of the block, skip them
+  bool blockend = mInputStream.currentPos() + line.size() == mInputStream.currentDocument().end;
+
+  for (int i(0); blockend && i < line.size(); ++i)
   {
     if (!line.at(i).isSpace())
-      blockend = -1;
+      blockend = false;
   }
 
-
-  if (blockend == -1)
+  if (!blockend)
   {
     for (auto ignore : mIgnoredSequences)
     {
@@ -606,7 +1176,7 @@ void DocumentProcessor::beginLine()
   }
   else
   {
-    mInputStream.discard(blockend);
+    mInputStream.discard(line.size());
   }
 }
 
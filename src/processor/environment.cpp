@@ -11,24 +11,48 @@ namespace dex
 
 QSharedPointer<Command> Environment::getCommand(const QString & name) const
 {
-  for (const auto & c : commands)
-  {
-    if (c->name() == name)
-      return c;
-  }
-
-  return nullptr;
+  return mCommandIndex.value(name);
 }
 
 QSharedPointer<Environment> Environment::getEnvironment(const QString & name) const
 {
-  for (const auto & e : environments)
-  {
-    if (e->name() == name)
-      return e;
-  }
+  return mEnvironmentIndex.value(name);
+}
+
+/*!
+ * \fn bool Environment::isRaw() const
+ * \brief Returns whether the content of the environment is captured verbatim.
+ *
+ * The content of a raw environment is not tokenized; it is passed as a
+ * single string to enterRaw(), and leave() is called right after.
+ */
+bool Environment::isRaw() const
+{
+  return false;
+}
+
+void Environment::enterRaw(const Options& options, const QString & content)
+{
+  (void)content;
+  enter(options);
+}
+
+void Environment::addCommand(const QSharedPointer<Command> & com)
+{
+  mCommands.append(com);
+
+  const QString name = com->name();
+  if (!mCommandIndex.contains(name))
+    mCommandIndex.insert(name, com);
+}
+
+void Environment::addEnvironment(const QSharedPointer<Environment> & env)
+{
+  mEnvironments.append(env);
 
-  return nullptr;
+  const QString name = env->name();
+  if (!mEnvironmentIndex.contains(name))
+    mEnvironmentIndex.insert(name, env);
 }
 
 } // namespace dex
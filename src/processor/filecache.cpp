@@ -0,0 +1,210 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/filecache.h"
+
+#include "dex/version.h"
+
+#include "dex/core/serialization.h"
+
+#include <script/types.h>
+
+#include <QCryptographicHash>
+#include <QDirIterator>
+#include <QFile>
+#include <QSaveFile>
+
+#include <QDebug>
+
+#include <algorithm>
+
+namespace dex
+{
+
+// entries written with a different layout are ignored
+static const int cache_format = 2;
+
+FileCache::FileCache(const QDir & directory, const QByteArray & profileHash)
+  : mDirectory(directory)
+  , mProfileHash(profileHash)
+{
+  if (!mDirectory.exists())
+    mDirectory.mkpath(".");
+}
+
+QString FileCache::entryPath(const QString & path) const
+{
+  const QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+  return mDirectory.filePath(QString::fromLatin1(key) + ".json");
+}
+
+/*!
+ * \fn bool FileCache::lookup(const QString & path, const QByteArray & contentHash, json::Json & contribution) const
+ * \brief Retrieves the contribution of a file, if it is still valid.
+ *
+ * \a contentHash must have been computed with hash().
+ */
+bool FileCache::lookup(const QString & path, const QByteArray & contentHash, json::Json & contribution) const
+{
+  QFile f{ entryPath(path) };
+  if (!f.open(QIODevice::ReadOnly))
+    return false;
+
+  const json::Json entry = serialization::fromJsonText(f.readAll());
+
+  if (!entry.isObject()
+    || entry["format"].toInt() != cache_format
+    || entry["dex"].toString() != QString(DEX_VERSION_STRING)
+    || entry["types"].toString() != QString::fromLatin1(typesHash())
+    || entry["path"].toString() != path
+    || entry["profile"].toString() != QString::fromLatin1(mProfileHash)
+    || entry["hash"].toString() != QString::fromLatin1(contentHash))
+  {
+    return false;
+  }
+
+  const json::Array inputs = entry["inputs"].toArray();
+  for (int i(0); i < inputs.length(); ++i)
+  {
+    const json::Json dep = inputs.at(i);
+    if (QString::fromLatin1(hashFile(dep["path"].toString())) != dep["hash"].toString())
+      return false;
+  }
+
+  contribution = entry["state"];
+  return true;
+}
+
+void FileCache::store(const QString & path, const QByteArray & contentHash, const QVector<Dependency> & inputs, const json::Json & contribution) const
+{
+  json::Object entry;
+  entry["format"] = cache_format;
+  entry["dex"] = QString(DEX_VERSION_STRING);
+  entry["types"] = QString::fromLatin1(typesHash());
+  entry["path"] = path;
+  entry["profile"] = QString::fromLatin1(mProfileHash);
+  entry["hash"] = QString::fromLatin1(contentHash);
+
+  json::Array deps;
+  for (const auto & d : inputs)
+  {
+    json::Object dep;
+    dep["path"] = d.path;
+    dep["hash"] = QString::fromLatin1(d.hash);
+    deps.push(dep);
+  }
+  entry["inputs"] = deps;
+
+  entry["state"] = contribution;
+
+  QSaveFile f{ entryPath(path) };
+  if (!f.open(QIODevice::WriteOnly))
+  {
+    qDebug() << "Could not write cache entry for" << path;
+    return;
+  }
+
+  f.write(serialization::toJsonText(entry));
+  f.commit();
+}
+
+/*!
+ * \fn QByteArray FileCache::typesHash()
+ * \brief Returns a hash of the ids of the builtin types.
+ *
+ * Serialized values store type ids, which move whenever a type is added
+ * to the patched libscript enumeration; entries written with other ids
+ * are ignored. The ids of the classes of the profile only depend on the
+ * profile and on the version of dex, which are also part of the key.
+ */
+QByteArray FileCache::typesHash()
+{
+  static const QByteArray result = []() -> QByteArray {
+    static const struct { const char *name; int id; } types[] = {
+      { "String", script::Type::String },
+      { "NullType", script::Type::NullType },
+      { "QChar", script::Type::QChar },
+      { "CharRef", script::Type::CharRef },
+      { "DexOptions", script::Type::DexOptions },
+      { "DexOptionsIterator", script::Type::DexOptionsIterator },
+      { "DexSpan", script::Type::DexSpan },
+      { "DexSpanWord", script::Type::DexSpanWord },
+      { "DexSpanLine", script::Type::DexSpanLine },
+      { "DexSpanParagraph", script::Type::DexSpanParagraph },
+      { "DexSpanRaw", script::Type::DexSpanRaw },
+      { "DexOutput", script::Type::DexOutput },
+      { "Json", script::Type::Json },
+      { "JsonArray", script::Type::JsonArray },
+      { "JsonObject", script::Type::JsonObject },
+      { "JsonArrayProxy", script::Type::JsonArrayProxy },
+      { "JsonObjectProxy", script::Type::JsonObjectProxy },
+      { "DexSpace", script::Type::DexSpace },
+      { "DexEOL", script::Type::DexEOL },
+      { "DexLiquidRenderer", script::Type::DexLiquidRenderer },
+      { "LiquidTemplate", script::Type::LiquidTemplate },
+      { "DexCommand", script::Type::DexCommand },
+      { "DexFile", script::Type::DexFile },
+      { "LastClassType", script::Type::LastClassType },
+    };
+
+    QCryptographicHash h{ QCryptographicHash::Sha1 };
+    for (const auto & t : types)
+      h.addData(QByteArray(t.name) + '=' + QByteArray::number(t.id) + ';');
+    return h.result().toHex();
+  }();
+
+  return result;
+}
+
+/*!
+ * \fn QByteArray FileCache::hash(const QString & content)
+ * \brief Returns the hash of the decoded content of a file.
+ */
+QByteArray FileCache::hash(const QString & content)
+{
+  const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(content.constData()), content.size() * static_cast<int>(sizeof(QChar)));
+  return QCryptographicHash::hash(bytes, QCryptographicHash::Sha1).toHex();
+}
+
+/*!
+ * \fn QByteArray FileCache::hashFile(const QString & path)
+ * \brief Returns the hash of the raw bytes of a file, or an empty array if the file cannot be read.
+ */
+QByteArray FileCache::hashFile(const QString & path)
+{
+  QFile f{ path };
+  if (!f.open(QIODevice::ReadOnly))
+    return QByteArray();
+
+  QCryptographicHash h{ QCryptographicHash::Sha1 };
+  h.addData(&f);
+  return h.result().toHex();
+}
+
+/*!
+ * \fn QByteArray FileCache::hashDirectory(const QDir & directory)
+ * \brief Returns a hash of the names and contents of all the files of a directory tree.
+ */
+QByteArray FileCache::hashDirectory(const QDir & directory)
+{
+  QStringList files;
+
+  QDirIterator it{ directory.absolutePath(), QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories };
+  while (it.hasNext())
+    files.append(directory.relativeFilePath(it.next()));
+
+  std::sort(files.begin(), files.end());
+
+  QCryptographicHash h{ QCryptographicHash::Sha1 };
+
+  for (const auto & f : files)
+  {
+    h.addData(f.toUtf8());
+    h.addData(hashFile(directory.filePath(f)));
+  }
+
+  return h.result().toHex();
+}
+
+} // namespace dex
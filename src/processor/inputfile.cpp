@@ -0,0 +1,87 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/inputfile.h"
+
+#include <QDebug>
+
+#include <limits>
+
+namespace dex
+{
+
+InputFile::InputFile(const QString & path)
+  : mFile(path)
+  , mMapping(nullptr)
+{
+
+}
+
+InputFile::~InputFile()
+{
+  close();
+}
+
+/*!
+ * \fn bool InputFile::open()
+ * \brief Opens the file and maps (or reads) its content.
+ *
+ * Files larger than what an int can index are rejected, as their
+ * content could not be decoded into a QString anyway.
+ */
+bool InputFile::open()
+{
+  if (!mFile.open(QIODevice::ReadOnly))
+    return false;
+
+  if (mFile.size() > std::numeric_limits<int>::max())
+  {
+    qDebug() << "Input file is too large:" << mFile.fileName();
+    mFile.close();
+    return false;
+  }
+
+  if (!mFile.isSequential() && mFile.size() > 0)
+    mMapping = mFile.map(0, mFile.size());
+
+  if (mMapping == nullptr)
+    mBuffer = mFile.readAll();
+
+  return true;
+}
+
+void InputFile::close()
+{
+  if (mMapping != nullptr)
+  {
+    mFile.unmap(mMapping);
+    mMapping = nullptr;
+  }
+
+  mBuffer.clear();
+  mFile.close();
+}
+
+const char* InputFile::data() const
+{
+  if (mMapping != nullptr)
+    return reinterpret_cast<const char*>(mMapping);
+
+  return mBuffer.constData();
+}
+
+int InputFile::size() const
+{
+  if (mMapping != nullptr)
+    return static_cast<int>(mFile.size());
+
+  return mBuffer.size();
+}
+
+QString InputFile::decode() const
+{
+  return QString::fromUtf8(data(), size());
+}
+
+} // namespace dex
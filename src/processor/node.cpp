@@ -0,0 +1,178 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/node.h"
+
+#include <vector>
+
+namespace dex
+{
+
+static const int max_shared_space_length = 8;
+
+static json::Json make_space(const QString & text)
+{
+  json::Json result;
+  result["content"] = text;
+  result["__type"] = script::Type::DexSpace;
+  return result;
+}
+
+// json::Json has reference semantics and scripts may modify the nodes
+// they receive, so each node is a new json::Json; only the strings,
+// which have value semantics, are shared.
+static const std::vector<QString> & shared_spaces()
+{
+  static const std::vector<QString> spaces = []() -> std::vector<QString> {
+    std::vector<QString> result;
+    for (int i(1); i <= max_shared_space_length; ++i)
+      result.push_back(QString(i, QChar(' ')));
+    return result;
+  }();
+
+  return spaces;
+}
+
+static bool is_shared_space(const QStringRef & text)
+{
+  if (text.isEmpty() || text.size() > max_shared_space_length)
+    return false;
+
+  for (const QChar & c : text)
+  {
+    if (c != ' ')
+      return false;
+  }
+
+  return true;
+}
+
+Node::Node()
+  : mKind(Null)
+  , mOffset(0)
+  , mLength(0)
+{
+
+}
+
+Node::Node(Kind k, const QString & source, int offset, int length)
+  : mKind(k)
+  , mSource(source)
+  , mOffset(offset)
+  , mLength(length)
+{
+
+}
+
+Node::Node(Kind k, const json::Json & value)
+  : mKind(k)
+  , mOffset(0)
+  , mLength(0)
+  , mValue(value)
+{
+
+}
+
+Node Node::fromJson(const json::Json & value)
+{
+  if (value.isNull())
+    return Node{};
+  else if (value.isArray())
+    return Node{ Group, value };
+  else
+    return Node{ Other, value };
+}
+
+/*!
+ * \fn bool Node::extend(const Node & other)
+ * \brief Appends a word or space that directly follows this node in the document.
+ *
+ * Returns false if either node is not a word or a space, or if \a other
+ * does not start where this node ends. The result is a word as soon as
+ * one of the merged nodes is a word.
+ */
+bool Node::extend(const Node & other)
+{
+  if (!(isWord() || isSpace()) || !(other.isWord() || other.isSpace()))
+    return false;
+
+  if (mSource.constData() != other.mSource.constData() || mOffset + mLength != other.mOffset)
+    return false;
+
+  mLength += other.mLength;
+
+  if (other.isWord())
+    mKind = Word;
+
+  return true;
+}
+
+json::Json Node::toJson() const
+{
+  switch (mKind)
+  {
+  case Word:
+    return text().toString();
+  case Space:
+    if (is_shared_space(text()))
+      return make_space(shared_spaces().at(mLength - 1));
+    return make_space(text().toString());
+  case EOL:
+    return createEOL();
+  case Group:
+  case Other:
+    return mValue;
+  case Null:
+  default:
+    return nullptr;
+  }
+}
+
+json::Json Node::createSpace(const QString & text)
+{
+  QStringRef ref{ &text };
+
+  if (is_shared_space(ref))
+    return make_space(shared_spaces().at(text.length() - 1));
+
+  return make_space(text);
+}
+
+json::Json Node::createEOL()
+{
+  json::Json result;
+  result["__type"] = script::Type::DexEOL;
+  return result;
+}
+
+json::Json WordTable::toJson(const Node & n)
+{
+  if (!n.isWord())
+    return n.toJson();
+
+  const QStringRef text = n.text();
+  const uint h = qHash(text);
+
+  for (auto it = mIndex.find(h); it != mIndex.end() && it.key() == h; ++it)
+  {
+    const QString & e = mEntries.at(it.value());
+    if (e == text)
+      return e;
+  }
+
+  const QString e = text.toString();
+
+  mIndex.insert(h, mEntries.size());
+  mEntries.push_back(e);
+
+  return e;
+}
+
+void WordTable::clear()
+{
+  mIndex.clear();
+  mEntries.clear();
+}
+
+} // namespace dex
@@ -0,0 +1,112 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/prefetcher.h"
+
+namespace dex
+{
+
+static qint64 memory_usage(const DocumentProcessor::PreparedFile & file)
+{
+  return qint64(file.content.size()) * sizeof(QChar)
+    + qint64(file.lexemes.size()) * sizeof(StreamTokenizer::Lexeme);
+}
+
+static void backoff(int & attempts)
+{
+  // the other side is usually running a script, or reading a file
+  if (++attempts < 64)
+    QThread::yieldCurrentThread();
+  else
+    QThread::msleep(1);
+}
+
+Prefetcher::Prefetcher(const DocumentProcessor & processor, const QStringList & files, int capacity, qint64 memory)
+  : mScanners(processor.scanners())
+  , mTokenize(processor.tokenizeAhead() && processor.cache() == nullptr)
+  , mFiles(files)
+  , mQueue(capacity)
+  , mMemoryBudget(memory)
+  , mQueuedMemory(0)
+{
+
+}
+
+Prefetcher::~Prefetcher()
+{
+  // the consumer may leave early, e.g. if a script throws
+  stop();
+}
+
+DocumentProcessor::PreparedFile Prefetcher::take()
+{
+  DocumentProcessor::PreparedFile result;
+
+  int attempts = 0;
+  while (!mQueue.tryPop(result))
+    backoff(attempts);
+
+  mQueuedMemory.fetchAndAddOrdered(-memory_usage(result));
+
+  if (result.error)
+    std::rethrow_exception(result.error);
+
+  return result;
+}
+
+void Prefetcher::stop()
+{
+  requestInterruption();
+  wait();
+}
+
+void Prefetcher::run()
+{
+  for (const auto & path : mFiles)
+  {
+    DocumentProcessor::PreparedFile file;
+
+    try
+    {
+      file = DocumentProcessor::prepareFile(path, mTokenize, mScanners);
+    }
+    catch (...)
+    {
+      file = DocumentProcessor::PreparedFile{};
+      file.path = path;
+      file.error = std::current_exception();
+    }
+
+    const bool failed = static_cast<bool>(file.error);
+    const qint64 cost = memory_usage(file);
+
+    int attempts = 0;
+
+    for (;;)
+    {
+      const qint64 queued = mQueuedMemory.loadAcquire();
+
+      if (queued == 0 || queued + cost <= mMemoryBudget)
+      {
+        mQueuedMemory.fetchAndAddOrdered(cost);
+
+        if (mQueue.tryPush(file))
+          break;
+
+        mQueuedMemory.fetchAndAddOrdered(-cost);
+      }
+
+      if (isInterruptionRequested())
+        return;
+
+      backoff(attempts);
+    }
+
+    // the consumer stops at the failed file
+    if (failed)
+      return;
+  }
+}
+
+} // namespace dex
@@ -31,21 +31,21 @@ void RootEnvironment::fill(const script::Script & s)
   {
     auto command = dex::Command::build(f);
     if (command != nullptr)
-      this->commands.append(command);
+      this->addCommand(command);
   }
 
   for (const auto & c : ns.classes())
   {
     auto command = dex::Command::build(c);
     if (command != nullptr)
-      this->commands.append(command);
+      this->addCommand(command);
   }
 
   for (const auto & nns : ns.namespaces())
   {
     auto env = dex::Environment::build(nns);
     if (env != nullptr)
-      this->environments.append(env);
+      this->addEnvironment(env);
   }
 }
 
@@ -4,30 +4,40 @@
 
 #include "dex/processor/state.h"
 
+#include "dex/core/list.h"
+#include "dex/core/value.h"
+
 #include <script/class.h>
+#include <script/classtemplate.h>
+#include <script/datamember.h>
 #include <script/engine.h>
 #include <script/locals.h>
+#include <script/object.h>
 #include <script/typesystem.h>
 
 #include <QDebug>
 
+#include <utility>
+
 namespace dex
 {
 
-State::TypeInfo State::static_type_info = State::TypeInfo{};
+static const int accept_node = -1;
+static const int reject_node = -2;
 
 
 State::State(const script::Value & val)
   : mValue(val)
+  , mNodeFilters(Node::Other + 1, accept_node)
 {
 
 }
 
-State State::create(script::Engine *e)
+State State::create(const script::Class & state_class)
 {
-  State ret{ e->construct(type_info().type, {}) };
+  script::Engine *e = state_class.engine();
 
-  script::Class state_class = e->typeSystem()->getClass(type_info().type);
+  State ret{ e->construct(state_class.id(), {}) };
 
   for (const auto & f : state_class.memberFunctions())
   {
@@ -44,6 +54,14 @@ State State::create(script::Engine *e)
       ret.mEndBlock = f;
     else if (f.name() == "dispatch" && f.returnType() == script::Type::Void)
       ret.mDispatch = f;
+    else if (f.name() == "dispatchBatch" && f.returnType() == script::Type::Void && f.prototype().count() == 2
+      && f.parameter(1).baseType() == script::Type::JsonArray)
+      ret.mDispatchBatch = f;
+    else if (f.name() == "merge" && f.returnType() == script::Type::Void && f.prototype().count() == 2
+      && f.parameter(1).baseType() == state_class.id())
+      ret.mMerge = f;
+    else if (f.name() == "nodeFilters" && f.isStatic() && f.returnType().baseType() == script::Type::Json)
+      ret.readNodeFilters(f);
   }
 
   if (ret.mInit.isNull() || ret.mBeginFile.isNull() || ret.mEndFile.isNull() || ret.mBeginBlock.isNull() || ret.mEndBlock.isNull() || ret.mDispatch.isNull())
@@ -55,6 +73,86 @@ State State::create(script::Engine *e)
   return ret;
 }
 
+/*!
+ * \fn void State::readNodeFilters(const script::Function & f)
+ * \brief Reads the node filters declared by the State class.
+ *
+ * The static function returns an object whose keys are node kinds ("Word",
+ * "Space" or "EOL"). A value of false means that nodes of this kind are never
+ * dispatched; a string names a List data member of the State, and nodes of
+ * this kind are then only dispatched while that list is not empty.
+ */
+void State::readNodeFilters(const script::Function & f)
+{
+  static const struct { const char *name; Node::Kind kind; } kinds[] = {
+    { "Word", Node::Word },
+    { "Space", Node::Space },
+    { "EOL", Node::EOL },
+  };
+
+  script::Engine *e = engine();
+  script::Class state_class = e->typeSystem()->getClass(mValue.type());
+
+  script::Value val = f.invoke({});
+  const json::Json filters = script::get<json::Json>(val);
+  e->destroy(val);
+
+  if (!filters.isObject())
+  {
+    qDebug() << "State::nodeFilters() must return an object";
+    throw std::runtime_error{ "Invalid node filters" };
+  }
+
+  for (const auto & k : kinds)
+  {
+    json::Json filter = filters[k.name];
+
+    if (filter.isNull())
+    {
+      continue;
+    }
+    else if (filter.isBoolean())
+    {
+      mNodeFilters[k.kind] = filter.toBool() ? accept_node : reject_node;
+      continue;
+    }
+    else if (filter.isString())
+    {
+      const int index = state_class.attributeIndex(filter.toString().toStdString());
+
+      if (index != -1)
+      {
+        script::Class attr_class = e->typeSystem()->getClass(mValue.toObject().at(index).type());
+
+        if (attr_class.isTemplateInstance() && attr_class.instanceOf() == script::ClassTemplate::get<dex::ListTemplate>(e))
+        {
+          mNodeFilters[k.kind] = index;
+          continue;
+        }
+      }
+    }
+
+    qDebug() << "Invalid filter for" << k.name << "nodes, expected a boolean or the name of a List member";
+    throw std::runtime_error{ "Invalid node filters" };
+  }
+}
+
+bool State::accepts(Node::Kind kind) const
+{
+  if (kind >= mNodeFilters.size())
+    return true;
+
+  const int filter = mNodeFilters.at(kind);
+
+  if (filter == accept_node)
+    return true;
+  else if (filter == reject_node)
+    return false;
+
+  const QList<dex::Value> & list = script::get<QList<dex::Value>>(mValue.toObject().at(filter));
+  return !list.isEmpty();
+}
+
 void State::init()
 {
   script::Engine *e = engine();
@@ -99,6 +197,136 @@ void State::dispatch(const json::Json& node)
   mDispatch.call(args);
 }
 
+void State::dispatchBatch(const json::Array& nodes)
+{
+  script::Engine *e = engine();
+
+  script::Locals args;
+
+  args.push(mValue);
+  args.push(e->construct<json::Array>(nodes));
+
+  mDispatchBatch.call(args);
+}
+
+/*!
+ * \fn void State::merge(const State & other)
+ * \brief Merges the content of another state into this one.
+ *
+ * If the State class defines a 'merge(const State&)' member function, it is
+ * used; otherwise the elements of each List data member of \a other are
+ * appended to the corresponding list of this state.
+ */
+void State::merge(const State & other)
+{
+  if (!mMerge.isNull())
+  {
+    mMerge.invoke({ mValue, other.mValue });
+    return;
+  }
+
+  const QVector<QList<dex::Value>*> lists = listMembers();
+  const QVector<QList<dex::Value>*> others = other.listMembers();
+
+  for (int i(0); i < lists.size(); ++i)
+    lists.at(i)->append(*others.at(i));
+}
+
+/*!
+ * \fn bool State::isMergedByLists() const
+ * \brief Returns whether the state is only made of List data members merged by merge().
+ *
+ * Only such a state can be split into the contributions of each file:
+ * anything else (a scalar data member, or a custom merge function) may
+ * depend on the order in which the files are processed.
+ */
+bool State::isMergedByLists() const
+{
+  if (!mMerge.isNull())
+    return false;
+
+  script::Class state_class = engine()->typeSystem()->getClass(mValue.type());
+  return listMembers().size() == static_cast<int>(state_class.dataMembers().size());
+}
+
+/*!
+ * \fn QVector<QList<dex::Value>> State::detachLists()
+ * \brief Empties the List data members of the state and returns their previous content.
+ *
+ * Together with reattachLists(), this lets the contribution of a single
+ * file be observed on the state that the scripts refer to.
+ */
+QVector<QList<dex::Value>> State::detachLists()
+{
+  const QVector<QList<dex::Value>*> members = listMembers();
+  QVector<QList<dex::Value>> result{ members.size() };
+
+  for (int i(0); i < members.size(); ++i)
+    result[i].swap(*members.at(i));
+
+  return result;
+}
+
+/*!
+ * \fn void State::reattachLists(QVector<QList<dex::Value>> & lists)
+ * \brief Restores lists returned by detachLists(), followed by the elements added since.
+ *
+ * No element is copied: the restored lists are swapped back in and the
+ * new elements are moved after them, so that the values the scripts
+ * refer to are preserved. \a lists is left empty.
+ */
+void State::reattachLists(QVector<QList<dex::Value>> & lists)
+{
+  const QVector<QList<dex::Value>*> members = listMembers();
+
+  for (int i(0); i < members.size(); ++i)
+  {
+    QList<dex::Value> added;
+    added.swap(*members.at(i));
+    members.at(i)->swap(lists[i]);
+
+    QList<dex::Value> & list = *members.at(i);
+    list.reserve(list.size() + added.size());
+
+    for (int j(0); j < added.size(); ++j)
+    {
+      // dex::Value has no move assignment, its content is swapped instead
+      dex::Value & src = added[j];
+      list.append(dex::Value{});
+      std::swap(list.last().typeinfo, src.typeinfo);
+      std::swap(list.last().value, src.value);
+    }
+  }
+
+  lists.clear();
+}
+
+QVector<QList<dex::Value>*> State::listMembers() const
+{
+  QVector<QList<dex::Value>*> result;
+
+  script::Engine *e = engine();
+  script::Class state_class = e->typeSystem()->getClass(mValue.type());
+  script::Object self = mValue.toObject();
+
+  for (const auto & dm : state_class.dataMembers())
+  {
+    script::Value attr = self.at(state_class.attributeIndex(dm.name));
+
+    if (!attr.type().isObjectType())
+      continue;
+
+    script::Class attr_class = e->typeSystem()->getClass(attr.type());
+
+    if (!attr_class.isTemplateInstance() || attr_class.instanceOf() != script::ClassTemplate::get<dex::ListTemplate>(e))
+      continue;
+
+    result.push_back(&script::get<QList<dex::Value>>(attr));
+  }
+
+  return result;
+}
+
 void State::destroy()
 {
   mValue.engine()->destroy(mValue);
@@ -36,6 +36,7 @@ UserCommand::UserCommand(const script::Function & fun)
   : mFunction(fun)
 {
   mName = fun.name().data();
+  compile();
 }
 
 UserCommand::UserCommand(const QString & name, script::Value && object, script::Function func)
@@ -43,7 +44,7 @@ UserCommand::UserCommand(const QString & name, script::Value && object, script::
   , mObject(object)
   , mFunction(func)
 {
-
+  compile();
 }
 
 UserCommand::~UserCommand()
@@ -62,89 +63,173 @@ QString UserCommand::name() const
 
 int UserCommand::parameterCount() const
 {
-  int count = mFunction.prototype().size();
+  return mParameterCount;
+}
+
+CommandSpan::Value UserCommand::span() const
+{
+  return mSpan;
+}
+
+bool UserCommand::acceptsOptions() const
+{
+  return mAcceptsOptions;
+}
 
-  if (acceptsOptions())
-    count -= 1;
-  if (span() != CommandSpan::NotApplicable)
-    count -= 1;
+static script::Value convert_generic(script::Engine *e, const json::Json & arg, const script::Type & t)
+{
+  return dex::serialization::deserialize(e, arg, t);
+}
 
-  return count;
+static script::Value convert_string(script::Engine *e, const json::Json & arg, const script::Type & t)
+{
+  if (arg.isString())
+    return e->newString(arg.toString());
+  return convert_generic(e, arg, t);
 }
 
-CommandSpan::Value UserCommand::span() const
+static script::Value convert_int(script::Engine *e, const json::Json & arg, const script::Type & t)
+{
+  if (arg.isInteger())
+    return e->newInt(arg.toInt());
+  return convert_generic(e, arg, t);
+}
+
+static script::Value convert_bool(script::Engine *e, const json::Json & arg, const script::Type & t)
+{
+  if (arg.isBoolean())
+    return e->newBool(arg.toBool());
+  return convert_generic(e, arg, t);
+}
+
+static script::Value convert_json(script::Engine *e, const json::Json & arg, const script::Type &)
+{
+  return e->construct<json::Json>(arg);
+}
+
+static script::Value convert_json_array(script::Engine *e, const json::Json & arg, const script::Type & t)
+{
+  if (arg.isArray())
+    return e->construct<json::Array>(arg.toArray());
+  return convert_generic(e, arg, t);
+}
+
+static json::Json result_generic(const script::Value & val)
+{
+  return dex::serialization::serialize(val);
+}
+
+static json::Json result_string(const script::Value & val)
+{
+  return val.toString();
+}
+
+static json::Json result_json(const script::Value & val)
+{
+  return script::get<json::Json>(val);
+}
+
+void UserCommand::compile()
 {
   static const script::Type span_types[] = {
     CommandSpan::getType(CommandSpan::Word),
     CommandSpan::getType(CommandSpan::Line),
     CommandSpan::getType(CommandSpan::Paragraph),
+    CommandSpan::getType(CommandSpan::Raw),
   };
 
   static const CommandSpan::Value span_values[] = {
     CommandSpan::Word,
     CommandSpan::Line,
     CommandSpan::Paragraph,
+    CommandSpan::Raw,
   };
 
-  if (mFunction.prototype().size() == 0)
-    return CommandSpan::NotApplicable;
+  const script::Prototype & proto = mFunction.prototype();
+
+  // the implicit object parameter of a call operator is not a command parameter
+  mFirstArgument = mObject.isNull() ? 0 : 1;
+  int end = static_cast<int>(proto.size());
 
-  script::Type last_param = mFunction.prototype().at(mFunction.prototype().size() - 1);
-  for (size_t i(0); i < 3; ++i)
+  mSpan = CommandSpan::NotApplicable;
+  if (end > mFirstArgument)
   {
-    if (last_param == span_types[i])
-      return span_values[i];
+    const script::Type last_param = proto.at(end - 1);
+    for (size_t i(0); i < 4; ++i)
+    {
+      if (last_param == span_types[i])
+      {
+        mSpan = span_values[i];
+        --end;
+        break;
+      }
+    }
   }
 
-  return CommandSpan::NotApplicable;
-}
+  mAcceptsOptions = end > mFirstArgument && proto.at(mFirstArgument).baseType() == script::make_type<Options>();
+  if (mAcceptsOptions)
+    ++mFirstArgument;
 
-bool UserCommand::acceptsOptions() const
-{
-  if (mFunction.prototype().size() == 0)
-    return false;
+  mParameterCount = end - mFirstArgument;
+
+  mParameterTypes.clear();
+  mConverters.clear();
+
+  for (int i(mFirstArgument); i < end; ++i)
+  {
+    const script::Type t = proto.at(i);
+    mParameterTypes.push_back(t);
+
+    if (t.baseType() == script::Type::String)
+      mConverters.push_back(convert_string);
+    else if (t.baseType() == script::Type::Int)
+      mConverters.push_back(convert_int);
+    else if (t.baseType() == script::Type::Boolean)
+      mConverters.push_back(convert_bool);
+    else if (t.baseType() == script::make_type<json::Json>())
+      mConverters.push_back(convert_json);
+    else if (t.baseType() == script::make_type<json::Array>())
+      mConverters.push_back(convert_json_array);
+    else
+      mConverters.push_back(convert_generic);
+  }
 
-  return mFunction.parameter(0).baseType() == script::make_type<Options>();
+  const script::Type rt = mFunction.returnType();
+  if (rt.baseType() == script::Type::String)
+    mResultConverter = result_string;
+  else if (rt.baseType() == script::make_type<json::Json>())
+    mResultConverter = result_json;
+  else
+    mResultConverter = result_generic;
 }
 
 json::Json UserCommand::invoke(DocumentProcessor*, const Options& opts, const QList<json::Json> & arguments)
 {
-  if (parameterCount() != arguments.size())
+  if (mParameterCount != arguments.size())
     throw std::runtime_error{ "Invalid argument count" };
 
   script::Engine *e = mFunction.engine();
 
   script::Locals values;
 
-  int proto_offset = 0;
-
   if (!mObject.isNull())
-  {
-    ++proto_offset;
     values.push(mObject);
-  }
 
-  if (acceptsOptions())
-  {
+  if (mAcceptsOptions)
     values.push(e->construct<Options>(opts));
-    ++proto_offset;
-  }
-
-  int span_offset = (span() != CommandSpan::NotApplicable) ? 1 : 0;
 
-  for (size_t i(proto_offset); i < mFunction.prototype().size() - span_offset; ++i)
-    values.push(dex::serialization::deserialize(arguments.at(i - proto_offset), mFunction.parameter(i)));
+  for (int i(0); i < mParameterCount; ++i)
+    values.push(mConverters.at(i)(e, arguments.at(i), mParameterTypes.at(i)));
 
-  auto command_span = span();
-  if (command_span != CommandSpan::NotApplicable)
-    values.push(CommandSpan::expose(command_span, e));
+  if (mSpan != CommandSpan::NotApplicable)
+    values.push(CommandSpan::expose(mSpan, e));
 
   script::Value val = mFunction.call(values);
   json::Json result = nullptr;
 
   if (val != script::Value::Void)
   {
-    result = dex::serialization::serialize(val);
+    result = mResultConverter(val);
   }
 
   e->destroy(val);
@@ -174,7 +259,8 @@ bool UserCommand::check(const script::Prototype & proto)
       {
         if (proto.at(i) == CommandSpan::getType(CommandSpan::Word)
           || proto.at(i) == CommandSpan::getType(CommandSpan::Line)
-          || proto.at(i) == CommandSpan::getType(CommandSpan::Paragraph))
+          || proto.at(i) == CommandSpan::getType(CommandSpan::Paragraph)
+          || proto.at(i) == CommandSpan::getType(CommandSpan::Raw))
         {
           return true;
         }
@@ -198,7 +284,7 @@ QSharedPointer<UserCommand> UserCommand::create(const script::Class & cla)
 {
   script::Engine *e = cla.engine();
 
-  if (!cla.inherits(e->typeSystem()->getClass(Command::type_info().type)))
+  if (!cla.inherits(e->typeSystem()->getClass(script::Type::DexCommand)))
     return nullptr;
 
   if (!cla.isDefaultConstructible())
@@ -6,6 +6,7 @@
 
 #include "dex/core/options.h"
 #include "dex/processor/command.h"
+#include "dex/processor/commandspan.h"
 
 #include <script/engine.h>
 #include <script/locals.h>
@@ -31,6 +32,13 @@ QSharedPointer<Environment> Environment::build(const script::Namespace & ns)
     {
       enter_function = f;
     }
+    else if (f.name() == "begin" && f.returnType() == script::Type::Void && f.prototype().size() == 3
+      && f.parameter(0) == script::make_type<Options>()
+      && f.parameter(1).baseType() == script::Type::String
+      && f.parameter(2) == CommandSpan::getType(CommandSpan::Raw))
+    {
+      enter_function = f;
+    }
   }
 
   if (enter_function.isNull() || leave_function.isNull())
@@ -47,7 +55,7 @@ QSharedPointer<Environment> Environment::build(const script::Namespace & ns)
     if (command == nullptr)
       continue;
 
-    result->commands.push_back(command);
+    result->addCommand(command);
   }
 
 
@@ -57,7 +65,7 @@ QSharedPointer<Environment> Environment::build(const script::Namespace & ns)
     if (env == nullptr)
       continue;
 
-    result->environments.push_back(env);
+    result->addEnvironment(env);
   }
 
   return result;
@@ -85,6 +93,26 @@ void UserEnvironment::enter(const Options& opts)
   mEnterFunction.call(args);
 }
 
+bool UserEnvironment::isRaw() const
+{
+  return mEnterFunction.prototype().size() == 3;
+}
+
+void UserEnvironment::enterRaw(const Options& opts, const QString & content)
+{
+  if (!isRaw())
+    return enter(opts);
+
+  script::Engine *e = mEnterFunction.engine();
+
+  script::Locals args;
+  args.push(e->construct<Options>(opts));
+  args.push(e->newString(content));
+  args.push(CommandSpan::expose(CommandSpan::Raw, e));
+
+  mEnterFunction.call(args);
+}
+
 void UserEnvironment::leave()
 {
   mLeaveFunction.invoke({});
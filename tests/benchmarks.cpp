@@ -0,0 +1,137 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the Dex project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dex/processor/documentprocessor.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <cstdlib>
+
+static QString generated_document(int size)
+{
+  const QString block =
+    "/*!\n"
+    " * \\class Shape\n"
+    " * \\brief Base class of the shapes.\n"
+    " *\n"
+    " * A shape can be \\b drawn, and its {area} is {\\tt always} positive.\n"
+    " *\n"
+    " * \\fun area\n"
+    " * \\brief Returns the area of the shape.\n"
+    " * \\returns a positive number\n"
+    " * \\endclass\n"
+    " */\n";
+
+  QString result;
+  result.reserve(size + block.size());
+
+  while (result.size() < size)
+    result += block;
+
+  return result;
+}
+
+/*!
+ * \fn void benchmark_tokenizer(const QString & text, int rounds)
+ * \brief Measures the throughput of StreamTokenizer::tokenize() on a whole document.
+ */
+static void benchmark_tokenizer(const QString & text, int rounds)
+{
+  using dex::StreamTokenizer;
+
+  QVector<StreamTokenizer::Lexeme> lexemes;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  for (int i(0); i < rounds; ++i)
+  {
+    lexemes.clear();
+    StreamTokenizer::tokenize(text, 0, text.size(), QChar('\\'), lexemes);
+  }
+
+  const qint64 elapsed = std::max<qint64>(timer.elapsed(), 1);
+  const double megabytes = double(text.size()) * rounds * sizeof(QChar) / (1024 * 1024);
+
+  QTextStream out{ stdout };
+  out << "tokenizer: " << lexemes.size() << " tokens, " << elapsed << " ms for " << rounds << " rounds, "
+    << (megabytes * 1000 / elapsed) << " MiB/s" << endl;
+}
+
+/*!
+ * \fn bool benchmark_startup(int rounds)
+ * \brief Measures the time taken by the app to process an empty input directory.
+ *
+ * This is mostly the startup of the application: creating the
+ * QCoreApplication, and compiling the profile and the output.
+ */
+static bool benchmark_startup(int rounds)
+{
+  QTemporaryDir dir;
+  if (!dir.isValid() || !QDir{ dir.path() }.mkpath("input") || !QDir{ dir.path() }.mkpath("output"))
+    return false;
+
+  const QStringList args{ "-p", "default", "--profiles-dir", DEX_BENCHMARK_PROFILES, "-g", "markdown",
+    "-i", QDir{ dir.path() }.filePath("input"), "-o", QDir{ dir.path() }.filePath("output") };
+
+  QElapsedTimer timer;
+  timer.start();
+
+  for (int i(0); i < rounds; ++i)
+  {
+    QProcess app;
+    app.start(DEX_BENCHMARK_APP, args);
+
+    if (!app.waitForFinished(-1) || app.exitCode() != 0)
+    {
+      QTextStream{ stderr } << "Could not run " << DEX_BENCHMARK_APP << endl;
+      return false;
+    }
+  }
+
+  QTextStream out{ stdout };
+  out << "startup: " << (timer.elapsed() / rounds) << " ms per run on an empty input directory" << endl;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app{ argc, argv };
+
+  // benchmarks [file [rounds]]
+  // A 16 MiB document is generated if no file is given.
+  QString text;
+
+  if (argc > 1)
+  {
+    QFile f{ QString::fromLocal8Bit(argv[1]) };
+    if (!f.open(QIODevice::ReadOnly))
+    {
+      QTextStream{ stderr } << "Could not open " << f.fileName() << endl;
+      return 1;
+    }
+
+    text = QString::fromUtf8(f.readAll());
+  }
+  else
+  {
+    text = generated_document(8 * 1024 * 1024);
+  }
+
+  const int rounds = argc > 2 ? std::atoi(argv[2]) : 10;
+
+  benchmark_tokenizer(text, std::max(rounds, 1));
+
+  return benchmark_startup(std::max(rounds, 1)) ? 0 : 1;
+}
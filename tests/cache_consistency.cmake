@@ -0,0 +1,88 @@
+# Runs dex on a copy of the input without a cache, then twice with a cache
+# (filling it, then reading from it), and checks that the three runs
+# produce the same files.
+# The copy is then edited: a file with a block, and a file pulled in with
+# \input by another one. A cached run must parse both files that depend
+# on the edits again, and produce the same files as an uncached run on
+# the edited input.
+#
+# Expects APP, PROFILES, INPUT and WORKDIR to be defined.
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+file(COPY "${INPUT}/" DESTINATION "${WORKDIR}/input")
+
+function(run_dex outdir)
+  file(MAKE_DIRECTORY "${WORKDIR}/${outdir}")
+  execute_process(
+    COMMAND "${APP}" -p default --profiles-dir "${PROFILES}" -g markdown -i "${WORKDIR}/input" -o "${WORKDIR}/${outdir}" ${ARGN}
+    WORKING_DIRECTORY "${WORKDIR}"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE err
+  )
+  if (NOT result EQUAL 0)
+    message(FATAL_ERROR "dex failed on ${outdir}:\n${out}\n${err}")
+  endif()
+  set(LOG "${out}${err}" PARENT_SCOPE)
+endfunction()
+
+function(expect_cached count run)
+  if (NOT LOG MATCHES " ${count} read from the cache")
+    message(FATAL_ERROR "The ${run} run did not read ${count} files from the cache:\n${LOG}")
+  endif()
+endfunction()
+
+function(compare_runs reference run)
+  file(GLOB_RECURSE expected RELATIVE "${WORKDIR}/${reference}" "${WORKDIR}/${reference}/*")
+  list(FILTER expected EXCLUDE REGEX "\\.dex-manifest\\.json$")
+
+  if (expected STREQUAL "")
+    message(FATAL_ERROR "The ${reference} run produced no file")
+  endif()
+
+  file(GLOB_RECURSE actual RELATIVE "${WORKDIR}/${run}" "${WORKDIR}/${run}/*")
+  list(FILTER actual EXCLUDE REGEX "\\.dex-manifest\\.json$")
+
+  if (NOT actual STREQUAL expected)
+    message(FATAL_ERROR "The ${run} run produced [${actual}] instead of [${expected}]")
+  endif()
+
+  foreach(f IN LISTS expected)
+    execute_process(
+      COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORKDIR}/${reference}/${f}" "${WORKDIR}/${run}/${f}"
+      RESULT_VARIABLE different
+    )
+    if (different)
+      message(FATAL_ERROR "${f} differs between the ${reference} and the ${run} run")
+    endif()
+  endforeach()
+endfunction()
+
+function(edit_input file from to)
+  file(READ "${WORKDIR}/input/${file}" content)
+  string(REPLACE "${from}" "${to}" edited "${content}")
+  if (edited STREQUAL content)
+    message(FATAL_ERROR "Could not edit ${file}")
+  endif()
+  file(WRITE "${WORKDIR}/input/${file}" "${edited}")
+endfunction()
+
+run_dex(uncached)
+run_dex(cold --cache "${WORKDIR}/cache")
+run_dex(warm --cache "${WORKDIR}/cache")
+expect_cached(3 warm)
+
+compare_runs(uncached cold)
+compare_runs(uncached warm)
+
+# shape.h changes, and square.h through square_members; circle.h does not
+edit_input(shape.h "Base class of the shapes." "Base class of all the shapes.")
+edit_input(square_members "a side of the square" "each side of the square")
+
+run_dex(edited --cache "${WORKDIR}/cache")
+expect_cached(1 edited)
+
+run_dex(edited_uncached)
+
+compare_runs(edited_uncached edited)
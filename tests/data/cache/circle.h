@@ -0,0 +1,13 @@
+/*!
+ * \class Circle
+ * \brief A circle.
+ *
+ * \fun radius
+ * \brief Returns the radius of the circle.
+ * \endclass
+ */
+class Circle : public Shape
+{
+public:
+  double radius() const;
+};
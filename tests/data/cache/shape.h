@@ -0,0 +1,16 @@
+/*!
+ * \class Shape
+ * \brief Base class of the shapes.
+ *
+ * A shape can be \b drawn.
+ *
+ * \fun area
+ * \brief Returns the area of the shape.
+ * \returns a positive number
+ * \endclass
+ */
+class Shape
+{
+public:
+  virtual double area() const = 0;
+};
@@ -0,0 +1,12 @@
+/*!
+ * \class Square
+ * \brief A square.
+ *
+ * \input square_members
+ * \endclass
+ */
+class Square : public Shape
+{
+public:
+  double side() const;
+};